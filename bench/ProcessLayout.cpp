@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+/*
+  A microbenchmark for the effect of other threads accessing a running
+  process. It runs the given program (which should loop for a while, e.g.
+  a few hundred milliseconds) repeatedly and reports the mean wall time per
+  run in each of the following modes:
+
+    idle      no other thread touches the process;
+    facility  a watchdog thread looks up process facilities in a tight loop,
+              writing to the control block of the process;
+    pause     a watchdog thread pauses the process every 100 microseconds
+              and the running thread resumes it.
+
+  The slowdown of the facility mode relative to the idle mode measures the
+  false sharing between the interpreter and the control block, hence the
+  benchmark is meant to be compared between builds of the library. It is not
+  part of the build, compile it against an installed library, e.g.:
+
+    g++ -std=c++14 -O2 ProcessLayout.cpp -lsharemind_vm -pthread
+
+  Usage: ProcessLayout <program> [runs]
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <sharemind/libvm/Process.h>
+#include <sharemind/libvm/Program.h>
+#include <sharemind/libvm/Vm.h>
+#include <thread>
+
+
+namespace {
+
+enum class Mode { Idle, Facility, Pause };
+
+double benchmark(sharemind::Program & program,
+                 unsigned const runs,
+                 Mode const mode)
+{
+    using sharemind::Process;
+    using Clock = std::chrono::steady_clock;
+
+    Process process(program);
+    std::atomic<bool> done(false);
+    std::thread watchdog(
+        [&process, &done, mode]() noexcept {
+            while (!done.load(std::memory_order_relaxed)) {
+                switch (mode) {
+                case Mode::Idle:
+                    return;
+                case Mode::Facility:
+                    process.findFacility("ProcessLayoutBenchmark");
+                    break;
+                case Mode::Pause:
+                    process.pause();
+                    std::this_thread::sleep_for(
+                                std::chrono::microseconds(100));
+                    break;
+                }
+            }
+        });
+
+    auto const start = Clock::now();
+    for (unsigned i = 0u; i < runs; ++i) {
+        auto result = process.tryRun();
+        while (result == Process::ExecutionResult::Trapped)
+            result = process.tryResume();
+        if (result != Process::ExecutionResult::Finished) {
+            std::cerr << "The program did not run to completion!"
+                      << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        process.reset();
+    }
+    auto const elapsed = Clock::now() - start;
+
+    done.store(true, std::memory_order_relaxed);
+    watchdog.join();
+    return std::chrono::duration<double, std::milli>(elapsed).count() / runs;
+}
+
+} // anonymous namespace
+
+int main(int argc, char * argv[]) {
+    if ((argc < 2) || (argc > 3)) {
+        std::cerr << "Usage: " << argv[0] << " <program> [runs]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    unsigned const runs =
+            (argc > 2) ? static_cast<unsigned>(std::atoi(argv[2])) : 20u;
+    if (!runs) {
+        std::cerr << "Invalid number of runs: " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        sharemind::Vm vm;
+        sharemind::Program program(vm, argv[1]);
+        std::cout << "idle:     " << benchmark(program, runs, Mode::Idle)
+                  << " ms/run" << std::endl;
+        std::cout << "facility: " << benchmark(program, runs, Mode::Facility)
+                  << " ms/run" << std::endl;
+        std::cout << "pause:    " << benchmark(program, runs, Mode::Pause)
+                  << " ms/run" << std::endl;
+    } catch (std::exception const & e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+/*
+  A microbenchmark for loading programs. It reads the given executable into
+  memory once, then loads it from memory repeatedly and reports the mean wall
+  time per load and per kibibyte of the executable, both without and with
+  opcode counting enabled. Loading is dominated by preparing the active
+  linking unit, so the time per kibibyte should stay roughly constant across
+  executables of different sizes.
+
+  System call bindings are resolved to a stub which fails when called, so any
+  executable can be loaded. The benchmark is not part of the build, compile it
+  against an installed library, e.g.:
+
+    g++ -std=c++14 -O2 ProgramLoad.cpp -lsharemind_vm
+
+  Usage: ProgramLoad <program> [loads]
+*/
+
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sharemind/libvm/Program.h>
+#include <sharemind/libvm/Vm.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+struct StubSyscall final: sharemind::Vm::SyscallWrapper {
+
+    void operator()(std::vector<::SharemindCodeBlock> &,
+                    std::vector<sharemind::Vm::Reference> &,
+                    std::vector<sharemind::Vm::ConstReference> &,
+                    ::SharemindCodeBlock *,
+                    sharemind::Vm::SyscallContext &) const final override
+    { throw std::logic_error("ProgramLoad does not run programs!"); }
+
+};
+
+double benchmark(std::vector<char> const & executable,
+                 unsigned const loads,
+                 bool const countOpcodes)
+{
+    using Clock = std::chrono::steady_clock;
+
+    sharemind::Vm vm;
+    std::shared_ptr<sharemind::Vm::SyscallWrapper> const stub(
+                std::make_shared<StubSyscall>());
+    vm.setSyscallFinder([stub](std::string const &) { return stub; });
+    vm.setOpcodeCountingEnabled(countOpcodes);
+
+    auto const start = Clock::now();
+    for (unsigned i = 0u; i < loads; ++i)
+        sharemind::Program(vm, executable.data(), executable.size());
+    auto const elapsed = Clock::now() - start;
+    return std::chrono::duration<double, std::milli>(elapsed).count() / loads;
+}
+
+void report(char const * const mode,
+            double const msPerLoad,
+            std::size_t const size)
+{
+    std::cout << mode << msPerLoad << " ms/load, "
+              << (msPerLoad * 1e6 / (static_cast<double>(size) / 1024.0))
+              << " ns/KiB" << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char * argv[]) {
+    if ((argc < 2) || (argc > 3)) {
+        std::cerr << "Usage: " << argv[0] << " <program> [loads]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    unsigned const loads =
+            (argc > 2) ? static_cast<unsigned>(std::atoi(argv[2])) : 100u;
+    if (!loads) {
+        std::cerr << "Invalid number of loads: " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<char> executable;
+    {
+        std::ifstream file(argv[1], std::ios::binary);
+        if (file)
+            executable.assign(std::istreambuf_iterator<char>(file),
+                              std::istreambuf_iterator<char>());
+        if (!file || executable.empty()) {
+            std::cerr << "Failed to read " << argv[1] << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    try {
+        report("plain:    ",
+               benchmark(executable, loads, false),
+               executable.size());
+        report("counting: ",
+               benchmark(executable, loads, true),
+               executable.size());
+    } catch (std::exception const & e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
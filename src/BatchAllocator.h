@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_LIBVM_BATCHALLOCATOR_H
+#define SHAREMIND_LIBVM_BATCHALLOCATOR_H
+
+#ifndef SHAREMIND_INTERNAL_
+#error including an internal header!
+#endif
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include "CacheLine.h"
+
+
+namespace sharemind {
+namespace Detail {
+
+/**
+  \brief A contiguous chunk of memory for a fixed number of equally sized
+         objects, each starting at a cache line boundary.
+  \details The chunk is allocated on the first allocation, which determines
+           the size of the objects. Deallocation is deferred until the arena
+           itself is destroyed.
+*/
+class __attribute__((visibility("internal"))) BatchArena {
+
+public: /* Methods: */
+
+    BatchArena(std::size_t const numObjects) noexcept
+        : m_numObjects(numObjects)
+    {}
+
+    BatchArena(BatchArena &&) = delete;
+    BatchArena(BatchArena const &) = delete;
+
+    ~BatchArena() noexcept { ::operator delete(m_memory); }
+
+    BatchArena & operator=(BatchArena &&) = delete;
+    BatchArena & operator=(BatchArena const &) = delete;
+
+    void * allocate(std::size_t const size, std::size_t const alignment) {
+        assert(alignment <= cacheLineSize);
+        (void) alignment;
+        auto const stride =
+                (size + cacheLineSize - 1u) / cacheLineSize * cacheLineSize;
+        if (!m_memory) {
+            assert(m_numObjects > 0u);
+            m_memory = ::operator new(stride * m_numObjects + cacheLineSize);
+            auto const address = reinterpret_cast<std::uintptr_t>(m_memory);
+            m_next = static_cast<char *>(m_memory)
+                     + (cacheLineSize - address % cacheLineSize)
+                       % cacheLineSize;
+            m_stride = stride;
+        }
+        if ((stride != m_stride) || !m_numObjects)
+            throw std::bad_alloc();
+        --m_numObjects;
+        auto * const r = m_next;
+        m_next += m_stride;
+        return r;
+    }
+
+private: /* Fields: */
+
+    std::size_t m_numObjects;
+    std::size_t m_stride = 0u;
+    void * m_memory = nullptr;
+    char * m_next = nullptr;
+
+};
+
+/**
+  \brief An allocator for std::allocate_shared() which places the objects and
+         their control blocks into a shared BatchArena.
+  \details The arena is kept alive by the allocators, including the copies in
+           the control blocks, and is freed when the last object is gone.
+*/
+template <typename T>
+class __attribute__((visibility("internal"))) BatchAllocator {
+
+    template <typename> friend class BatchAllocator;
+
+public: /* Types: */
+
+    using value_type = T;
+
+public: /* Methods: */
+
+    BatchAllocator(std::shared_ptr<BatchArena> arena) noexcept
+        : m_arena(std::move(arena))
+    {}
+
+    template <typename U>
+    BatchAllocator(BatchAllocator<U> const & copy) noexcept
+        : m_arena(copy.m_arena)
+    {}
+
+    T * allocate(std::size_t const n) {
+        assert(n == 1u);
+        (void) n;
+        return static_cast<T *>(m_arena->allocate(sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, std::size_t) noexcept {}
+
+    template <typename U>
+    bool operator==(BatchAllocator<U> const & rhs) const noexcept
+    { return m_arena == rhs.m_arena; }
+
+    template <typename U>
+    bool operator!=(BatchAllocator<U> const & rhs) const noexcept
+    { return m_arena != rhs.m_arena; }
+
+private: /* Fields: */
+
+    std::shared_ptr<BatchArena> m_arena;
+
+};
+
+} /* namespace Detail { */
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_LIBVM_BATCHALLOCATOR_H */
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#include "BuiltinSyscalls.h"
+
+#include <cassert>
+#include <chrono>
+#include <utility>
+#include <vector>
+#include "Process_p.h"
+
+
+namespace sharemind {
+namespace Detail {
+
+namespace {
+
+using Arguments = std::vector<::SharemindCodeBlock>;
+using References = std::vector<Vm::Reference>;
+using ConstReferences = std::vector<Vm::ConstReference>;
+
+ProcessState & processState(Vm::SyscallContext & context) noexcept {
+    /* The VM only calls system calls with contexts of its processes: */
+    return static_cast<ProcessState::SyscallContext &>(context).m_state;
+}
+
+std::string nameArgument(ConstReferences const & constReferences) {
+    if (constReferences.size() != 1u)
+        throw Process::InvalidArgumentException();
+    auto const & cref = constReferences.front();
+    auto const * const data = static_cast<char const *>(cref.data.get());
+    auto size = cref.size;
+    /* Strings from bytecode are usually NUL-terminated: */
+    if (size && !data[size - 1u])
+        --size;
+    return std::string(data, size);
+}
+
+/* uint64 Process_getInput(cref name) */
+struct GetInputSyscall final: Vm::SyscallWrapper {
+
+    void operator()(Arguments & arguments,
+                    References & references,
+                    ConstReferences & constReferences,
+                    ::SharemindCodeBlock * returnValue,
+                    Vm::SyscallContext & context) const final override
+    {
+        if (!arguments.empty() || !references.empty() || !returnValue)
+            throw Process::InvalidArgumentException();
+        returnValue->uint64[0] =
+                processState(context).inputPtr(nameArgument(constReferences));
+    }
+
+};
+
+/* void Process_setOutput(cref name, uint64 ptr) */
+struct SetOutputSyscall final: Vm::SyscallWrapper {
+
+    void operator()(Arguments & arguments,
+                    References & references,
+                    ConstReferences & constReferences,
+                    ::SharemindCodeBlock *,
+                    Vm::SyscallContext & context) const final override
+    {
+        if ((arguments.size() != 1u) || !references.empty())
+            throw Process::InvalidArgumentException();
+        processState(context).setOutput(nameArgument(constReferences),
+                                        arguments.front().uint64[0]);
+    }
+
+};
+
+/* uint64 Process_getSharedSegment(cref name) */
+struct GetSharedSegmentSyscall final: Vm::SyscallWrapper {
+
+    void operator()(Arguments & arguments,
+                    References & references,
+                    ConstReferences & constReferences,
+                    ::SharemindCodeBlock * returnValue,
+                    Vm::SyscallContext & context) const final override
+    {
+        if (!arguments.empty() || !references.empty() || !returnValue)
+            throw Process::InvalidArgumentException();
+        returnValue->uint64[0] =
+                processState(context).sharedSegmentPtr(
+                    nameArgument(constReferences));
+    }
+
+};
+
+/*
+  Calls the wrapped system call, timing it for the calling process. A call
+  which suspends is timed until it is completed:
+*/
+struct TimedSyscall final: Vm::SyscallWrapper {
+
+    TimedSyscall(std::shared_ptr<Vm::SyscallWrapper> syscall_,
+                 std::size_t const bindingIndex_) noexcept
+        : syscall(std::move(syscall_))
+        , bindingIndex(bindingIndex_)
+    {}
+
+    void operator()(Arguments & arguments,
+                    References & references,
+                    ConstReferences & constReferences,
+                    ::SharemindCodeBlock * returnValue,
+                    Vm::SyscallContext & context) const final override
+    {
+        using Clock = std::chrono::steady_clock;
+        auto & process = processState(context);
+        auto const start(Clock::now());
+        try {
+            (*syscall)(arguments,
+                       references,
+                       constReferences,
+                       returnValue,
+                       context);
+        } catch (...) {
+            process.recordSyscall(bindingIndex, Clock::now() - start);
+            throw;
+        }
+        if (!process.deferSyscallTiming(bindingIndex, start))
+            process.recordSyscall(bindingIndex, Clock::now() - start);
+    }
+
+    std::shared_ptr<Vm::SyscallWrapper> const syscall;
+    std::size_t const bindingIndex;
+
+};
+
+} // anonymous namespace
+
+std::shared_ptr<Vm::SyscallWrapper> findBuiltinSyscall(
+        std::string const & signature) noexcept
+{
+    try {
+        if (signature == "Process_getInput") {
+            static auto const getInput(std::make_shared<GetInputSyscall>());
+            return getInput;
+        }
+        if (signature == "Process_setOutput") {
+            static auto const setOutput(std::make_shared<SetOutputSyscall>());
+            return setOutput;
+        }
+        if (signature == "Process_getSharedSegment") {
+            static auto const getSharedSegment(
+                        std::make_shared<GetSharedSegmentSyscall>());
+            return getSharedSegment;
+        }
+    } catch (...) {}
+    return nullptr;
+}
+
+std::shared_ptr<Vm::SyscallWrapper> makeTimedSyscall(
+        std::shared_ptr<Vm::SyscallWrapper> syscall,
+        std::size_t const bindingIndex)
+{
+    assert(syscall);
+    return std::make_shared<TimedSyscall>(std::move(syscall), bindingIndex);
+}
+
+} // namespace Detail {
+} // namespace sharemind {
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_LIBVM_BUILTINSYSCALLS_H
+#define SHAREMIND_LIBVM_BUILTINSYSCALLS_H
+
+#ifndef SHAREMIND_INTERNAL_
+#error including an internal header!
+#endif
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "Vm.h"
+
+
+namespace sharemind {
+namespace Detail {
+
+/**
+  \brief Finds a system call provided by the VM itself.
+  \details These are used when the syscall finder of the VM does not provide a
+           system call with the given signature.
+  \returns the system call, or nullptr if there is no such builtin.
+*/
+std::shared_ptr<Vm::SyscallWrapper> findBuiltinSyscall(
+        std::string const & signature) noexcept
+        __attribute__((visibility("internal")));
+
+/**
+  \brief Wraps a system call to record its latency to the statistics of the
+         calling process.
+  \param[in] syscall The system call to wrap.
+  \param[in] bindingIndex The index of the system call binding.
+  \see Vm::setSyscallStatisticsEnabled()
+*/
+std::shared_ptr<Vm::SyscallWrapper> makeTimedSyscall(
+        std::shared_ptr<Vm::SyscallWrapper> syscall,
+        std::size_t const bindingIndex)
+        __attribute__((visibility("internal")));
+
+} /* namespace Detail { */
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_LIBVM_BUILTINSYSCALLS_H */
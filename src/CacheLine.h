@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_LIBVM_CACHELINE_H
+#define SHAREMIND_LIBVM_CACHELINE_H
+
+#ifndef SHAREMIND_INTERNAL_
+#error including an internal header!
+#endif
+
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <new>
+
+
+namespace sharemind {
+namespace Detail {
+
+/** \brief The assumed size of a CPU cache line, in bytes. */
+constexpr std::size_t const cacheLineSize = 64u;
+
+/**
+  \brief A stateless allocator aligning all allocations to cache lines.
+  \details Keeps the allocated objects from sharing cache lines with
+           unrelated allocations. Also needed for over-aligned types, since
+           operator new does not respect alignments above that of
+           std::max_align_t before C++17.
+*/
+template <typename T>
+class __attribute__((visibility("internal"))) CacheAlignedAllocator {
+
+public: /* Types: */
+
+    using value_type = T;
+
+public: /* Methods: */
+
+    CacheAlignedAllocator() noexcept = default;
+
+    template <typename U>
+    CacheAlignedAllocator(CacheAlignedAllocator<U> const &) noexcept {}
+
+    T * allocate(std::size_t const n) {
+        static_assert(alignof(T) <= cacheLineSize, "");
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+            throw std::bad_alloc();
+        void * r;
+        if (::posix_memalign(&r, cacheLineSize, n * sizeof(T)))
+            throw std::bad_alloc();
+        return static_cast<T *>(r);
+    }
+
+    void deallocate(T * const ptr, std::size_t) noexcept { std::free(ptr); }
+
+    template <typename U>
+    bool operator==(CacheAlignedAllocator<U> const &) const noexcept
+    { return true; }
+
+    template <typename U>
+    bool operator!=(CacheAlignedAllocator<U> const &) const noexcept
+    { return false; }
+
+};
+
+} /* namespace Detail { */
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_LIBVM_CACHELINE_H */
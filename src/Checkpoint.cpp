@@ -0,0 +1,834 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#include "Process_p.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <sharemind/likely.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "InputMemory.h"
+#include "PublicMemory.h"
+#include "Sha256.h"
+
+
+namespace sharemind {
+namespace Detail {
+
+namespace {
+
+/*
+  The checkpoint format consists of native 64-bit words and raw memory, so
+  checkpoints can only be restored by the same build of the VM:
+
+    header:   magic, version, flags, id, base id
+    program:  linking unit index, code size, data size, BSS size, RODATA hash
+    process:  state, instruction pointer, return value, FPU state
+    memory:   reserved memory usage, peak usage of public heap, private,
+              reserved and total memory
+    slots:    count, (pointer, size, hash, flags, [data]) for each slot
+    segments: count, (name, pointer, size) for each mapped shared segment
+    frames:   count, current frame index, next frame index,
+              (return address, stack size, stack) for each frame,
+              (return value location, (size, location) for each reference and
+              constant reference) for each frame
+    buffers:  count, (name, pointer) for each input,
+              count, (name, pointer, [size, data]) for each output
+    trailer:  magic
+
+  The hashes are 32-byte SHA-256 digests.
+*/
+
+char const checkpointMagic[8u] = { 'S', 'M', 'V', 'M', 'C', 'K', 'P', 'T' };
+constexpr std::uint64_t const checkpointVersion = 2u;
+constexpr std::uint64_t const noIndex =
+        std::numeric_limits<std::uint64_t>::max();
+
+/* Checkpoint flags: */
+constexpr std::uint64_t const CheckpointIncremental = 1u;
+
+/* Memory slot flags: */
+constexpr std::uint64_t const SlotWritable = 1u;
+constexpr std::uint64_t const SlotUnchanged = 2u;
+
+/* Location kinds: */
+constexpr std::uint64_t const NullLocation = 0u;
+constexpr std::uint64_t const SlotLocation = 1u;
+constexpr std::uint64_t const StackLocation = 2u;
+
+/* Reading limits: */
+constexpr std::size_t const unknownSize =
+        std::numeric_limits<std::size_t>::max();
+/** Sizes up to this are allocated without checking the stream first. */
+constexpr std::size_t const maxUncheckedSize = 1u << 16u;
+/** The chunk size for staging data from unseekable streams. */
+constexpr std::size_t const stagingChunkSize = 1u << 20u;
+
+/**
+  \brief A SHA-256 hash of the size and the contents of the slot.
+  \details Incremental checkpoints omit slots whose hashes match, hence the
+           hash must be collision resistant.
+*/
+Sha256::Digest hashSlot(MemorySlot const & slot) noexcept {
+    Sha256 hash;
+    std::uint64_t const size = slot.size();
+    hash.update(&size, sizeof(size));
+    hash.update(slot.data(), slot.size());
+    return hash.finish();
+}
+
+std::uint64_t newCheckpointId() {
+    std::random_device rd;
+    std::uint64_t r;
+    do {
+        r = (static_cast<std::uint64_t>(rd()) << 32u) ^ rd();
+    } while (!r); // Zero denotes no base
+    return r;
+}
+
+Sha256::Digest hashRoData(PreparedLinkingUnit const & unit) {
+    return hashSlot(unit.roDataSection);
+}
+
+class CheckpointWriter {
+
+public: /* Methods: */
+
+    CheckpointWriter(std::ostream & os) noexcept : m_os(os) {}
+
+    void write(void const * const data, std::size_t const size) {
+        if (size && !m_os.write(static_cast<char const *>(data),
+                                static_cast<std::streamsize>(size)))
+            throw Process::CheckpointIoException();
+    }
+
+    void writeUint(std::uint64_t const value) { write(&value, sizeof(value)); }
+
+    void writeDigest(Sha256::Digest const & value)
+    { write(value.data(), value.size()); }
+
+    void writeString(std::string const & value) {
+        writeUint(value.size());
+        write(value.data(), value.size());
+    }
+
+private: /* Fields: */
+
+    std::ostream & m_os;
+
+};
+
+/**
+  \brief Reads a checkpoint, making sure that the sizes in the checkpoint do
+         not allocate more memory than the data in the stream warrants.
+*/
+class CheckpointReader {
+
+public: /* Methods: */
+
+    CheckpointReader(std::istream & is)
+        : m_is(is)
+        , m_left(sizeLeft(is))
+    {}
+
+    void read(void * const data, std::size_t size) {
+        if (!size)
+            return;
+        auto * out = static_cast<char *>(data);
+        if (auto const staged = std::min(size, m_staged.size() - m_stagedPos)) {
+            std::memcpy(out, m_staged.data() + m_stagedPos, staged);
+            m_stagedPos += staged;
+            out += staged;
+            size -= staged;
+            if (!size)
+                return;
+        }
+        if (size > m_left)
+            throw Process::InvalidCheckpointException();
+        if (!m_is.read(out, static_cast<std::streamsize>(size)))
+            throw Process::InvalidCheckpointException();
+        if (m_left != unknownSize)
+            m_left -= size;
+    }
+
+    /**
+      \brief Makes sure that the stream holds at least the given number of
+             bytes more, before memory for them is allocated.
+      \details For unseekable streams, larger amounts of data are read ahead
+               in bounded chunks, so the memory used grows only with the data
+               actually present in the stream.
+      \throws InvalidCheckpointException if the stream ends before that.
+    */
+    void require(std::size_t const size) {
+        if (size <= maxUncheckedSize)
+            return;
+        if (m_left != unknownSize) {
+            if (size > m_left)
+                throw Process::InvalidCheckpointException();
+            return;
+        }
+        m_staged.erase(0u, m_stagedPos);
+        m_stagedPos = 0u;
+        while (m_staged.size() < size) {
+            auto const oldSize = m_staged.size();
+            auto const chunk = std::min(size - oldSize, stagingChunkSize);
+            m_staged.resize(oldSize + chunk);
+            if (!m_is.read(&m_staged[oldSize],
+                           static_cast<std::streamsize>(chunk)))
+                throw Process::InvalidCheckpointException();
+        }
+    }
+
+    /**
+      \brief Like require(), but for the given number of items of at least
+             the given encoded size each.
+    */
+    void require(std::uint64_t const count, std::size_t const itemSize) {
+        assert(itemSize);
+        if (count > std::numeric_limits<std::size_t>::max() / itemSize)
+            throw Process::InvalidCheckpointException();
+        require(static_cast<std::size_t>(count) * itemSize);
+    }
+
+    std::uint64_t readUint() {
+        std::uint64_t value;
+        read(&value, sizeof(value));
+        return value;
+    }
+
+    std::size_t readSize() {
+        auto const value = readUint();
+        if (unlikely(value > std::numeric_limits<std::size_t>::max()))
+            throw Process::InvalidCheckpointException();
+        return static_cast<std::size_t>(value);
+    }
+
+    std::string readString() {
+        auto const size = readSize();
+        require(size);
+        std::string r(size, '\0');
+        read(&r[0u], r.size());
+        return r;
+    }
+
+    Sha256::Digest readDigest() {
+        Sha256::Digest r;
+        read(r.data(), r.size());
+        return r;
+    }
+
+    void readMagic() {
+        char magic[sizeof(checkpointMagic)];
+        read(magic, sizeof(magic));
+        if (std::memcmp(magic, checkpointMagic, sizeof(magic)) != 0)
+            throw Process::InvalidCheckpointException();
+    }
+
+private: /* Methods: */
+
+    /** \returns the number of bytes left in the stream, if seekable. */
+    static std::size_t sizeLeft(std::istream & is) {
+        auto const pos = is.tellg();
+        if (pos == std::istream::pos_type(-1))
+            return unknownSize;
+        if (!is.seekg(0, std::ios_base::end)) {
+            is.clear();
+            is.seekg(pos);
+            return unknownSize;
+        }
+        auto const end = is.tellg();
+        if (!is.seekg(pos) || (end == std::istream::pos_type(-1)))
+            throw Process::CheckpointIoException();
+        std::streamoff const left = end - pos;
+        if (left < 0)
+            return 0u;
+        if (static_cast<std::uintmax_t>(left) >= unknownSize)
+            return unknownSize;
+        return static_cast<std::size_t>(left);
+    }
+
+private: /* Fields: */
+
+    std::istream & m_is;
+    /** The number of bytes left in the stream, or unknownSize. */
+    std::size_t m_left;
+    /** Data read ahead from an unseekable stream by require(). */
+    std::string m_staged;
+    std::size_t m_stagedPos = 0u;
+
+};
+
+/**
+  \brief Maps the memory of a process to locations relative to memory slots
+         and stack frames, which are independent of the address space.
+*/
+class LocationEncoder {
+
+private: /* Types: */
+
+    struct Range {
+        char const * begin;
+        char const * end;
+        std::uint64_t kind;
+        std::uint64_t id;
+    };
+
+public: /* Methods: */
+
+    void addRange(void const * const data,
+                  std::size_t const size,
+                  std::uint64_t const kind,
+                  std::uint64_t const id)
+    {
+        auto const * const begin = static_cast<char const *>(data);
+        m_ranges.emplace_back(Range{begin, begin + size, kind, id});
+    }
+
+    void sort() {
+        std::sort(m_ranges.begin(),
+                  m_ranges.end(),
+                  [](Range const & lhs, Range const & rhs) noexcept
+                  { return lhs.begin < rhs.begin; });
+    }
+
+    /** \pre sort() has been called after the last addRange(). */
+    void write(CheckpointWriter & writer,
+               void const * const ptr,
+               std::size_t const size) const
+    {
+        if (!ptr) {
+            writer.writeUint(NullLocation);
+            writer.writeUint(0u);
+            writer.writeUint(0u);
+            return;
+        }
+        auto const * const p = static_cast<char const *>(ptr);
+        auto it(std::upper_bound(m_ranges.begin(),
+                                 m_ranges.end(),
+                                 p,
+                                 [](char const * const p, Range const & r)
+                                         noexcept
+                                 { return p < r.begin; }));
+        if (unlikely(it == m_ranges.begin()))
+            throw Process::UncheckpointableStateException();
+        --it;
+        if (unlikely((p > it->end) || (size > std::size_t(it->end - p))))
+            throw Process::UncheckpointableStateException();
+        writer.writeUint(it->kind);
+        writer.writeUint(it->id);
+        writer.writeUint(static_cast<std::uint64_t>(p - it->begin));
+    }
+
+private: /* Fields: */
+
+    std::vector<Range> m_ranges;
+
+};
+
+struct DecodedLocation {
+    void * ptr;
+    /** The owner of the memory, or nullptr for stack memory. */
+    MemoryMap::ValueType owner;
+};
+
+} // anonymous namespace
+
+void ProcessState::writeCheckpoint(std::ostream & os, bool const incremental) {
+    assert((m_state == State::Initialized) || (m_state == State::Trapped));
+
+    /* The error of an asynchronous system call can not be serialized: */
+    if (m_pendingSyscallException)
+        throw Process::UncheckpointableStateException();
+
+    CheckpointWriter writer(os);
+    std::unique_ptr<CheckpointState> newState(
+                new CheckpointState{newCheckpointId(), {}});
+    CheckpointState const * const baseState =
+            incremental ? m_checkpointState.get() : nullptr;
+
+    writer.write(checkpointMagic, sizeof(checkpointMagic));
+    writer.writeUint(checkpointVersion);
+    writer.writeUint(baseState ? CheckpointIncremental : 0u);
+    writer.writeUint(newState->id);
+    writer.writeUint(baseState ? baseState->id : 0u);
+
+    auto const & unit = *m_preparedLinkingUnit;
+    writer.writeUint(m_activeLinkingUnitIndex);
+    writer.writeUint(unit.codeSection.size());
+    writer.writeUint(unit.rwDataSection.size());
+    writer.writeUint(unit.bssSectionSize);
+    writer.writeDigest(hashRoData(unit));
+
+    writer.writeUint(m_state == State::Trapped ? 1u : 0u);
+    writer.writeUint(m_currentIp);
+    writer.write(&m_returnValue, sizeof(m_returnValue));
+    writer.writeUint(m_fpuState);
+
+    /*
+      The usage of the public heap is recomputed from the slots on restore, and
+      the limits are those of the restoring process. Private memory is owned by
+      system calls, hence it is not saved:
+    */
+    writer.writeUint(m_memReserved.usage);
+    for (auto const * const memInfo
+         : {&m_memPublicHeap, &m_memPrivate, &m_memReserved, &m_memTotal})
+        writer.writeUint(memInfo->max);
+
+    /*
+      Shared segments are part of the program, hence only their names are
+      saved, like the RODATA section (slot 1) is not saved at all:
+    */
+    std::vector<std::pair<std::string const *, Input const *> > segments;
+    if (m_ioBuffers)
+        for (auto const & segment : m_ioBuffers->sharedSegments)
+            if (segment.second.slot
+                && (m_memoryMap.get(segment.second.ptr)
+                    == segment.second.slot))
+                segments.emplace_back(&segment.first, &segment.second);
+
+    LocationEncoder locations;
+    std::vector<std::pair<MemoryMap::KeyType, MemorySlot const *> > slots;
+    std::unordered_map<MemorySlot const *, MemoryMap::KeyType> slotPtrs;
+    m_memoryMap.forEachSlot(
+                [&](MemoryMap::KeyType const ptr,
+                    MemoryMap::ValueType const & slot)
+                {
+                    locations.addRange(slot->data(),
+                                       slot->size(),
+                                       SlotLocation,
+                                       ptr);
+                    slotPtrs.emplace(slot.get(), ptr);
+                    if (ptr == 1u)
+                        return;
+                    for (auto const & segment : segments)
+                        if (segment.second->ptr == ptr)
+                            return;
+                    slots.emplace_back(ptr, slot.get());
+                });
+    writer.writeUint(slots.size());
+    for (auto const & ptrAndSlot : slots) {
+        auto const & slot = *ptrAndSlot.second;
+        auto const hash = hashSlot(slot);
+        std::uint64_t flags = slot.isWritable() ? SlotWritable : 0u;
+        if (baseState) {
+            auto const it(baseState->slotHashes.find(ptrAndSlot.first));
+            if ((it != baseState->slotHashes.end()) && (it->second == hash))
+                flags |= SlotUnchanged;
+        }
+        writer.writeUint(ptrAndSlot.first);
+        writer.writeUint(slot.size());
+        writer.writeDigest(hash);
+        writer.writeUint(flags);
+        if (!(flags & SlotUnchanged))
+            writer.write(slot.data(), slot.size());
+        newState->slotHashes.emplace(ptrAndSlot.first, hash);
+    }
+
+    writer.writeUint(segments.size());
+    for (auto const & segment : segments) {
+        writer.writeString(*segment.first);
+        writer.writeUint(segment.second->ptr);
+        writer.writeUint(segment.second->slot->size());
+    }
+
+    {
+        std::uint64_t index = 0u;
+        std::uint64_t thisIndex = noIndex;
+        std::uint64_t nextIndex = noIndex;
+        for (auto const & frame : m_frames) {
+            if (&frame == m_thisFrame)
+                thisIndex = index;
+            if (&frame == m_nextFrame)
+                nextIndex = index;
+            locations.addRange(frame.stack.data(),
+                               frame.stack.size() * sizeof(SharemindCodeBlock),
+                               StackLocation,
+                               index);
+            ++index;
+        }
+        assert(thisIndex != noIndex);
+        writer.writeUint(m_frames.size());
+        writer.writeUint(thisIndex);
+        writer.writeUint(nextIndex);
+    }
+    locations.sort();
+
+    auto const * const codeStart = unit.codeSection.constData();
+    for (auto const & frame : m_frames) {
+        writer.writeUint(frame.returnAddr
+                         ? static_cast<std::uint64_t>(
+                               frame.returnAddr - codeStart)
+                         : noIndex);
+        writer.writeUint(frame.stack.size());
+        writer.write(frame.stack.data(),
+                     frame.stack.size() * sizeof(SharemindCodeBlock));
+    }
+    for (auto const & frame : m_frames) {
+        locations.write(writer,
+                        frame.returnValueAddr,
+                        sizeof(SharemindCodeBlock));
+        writer.writeUint(frame.refstack.size());
+        for (auto const & ref : frame.refstack) {
+            writer.writeUint(ref.size);
+            locations.write(writer, ref.data.get(), ref.size);
+        }
+        writer.writeUint(frame.crefstack.size());
+        for (auto const & cref : frame.crefstack) {
+            writer.writeUint(cref.size);
+            locations.write(writer, cref.data.get(), cref.size);
+        }
+    }
+
+    if (m_ioBuffers) {
+        /* Inputs freed by the bytecode are gone: */
+        std::vector<std::pair<std::string const *, std::uint64_t> > inputs;
+        for (auto const & input : m_ioBuffers->inputs)
+            if (m_memoryMap.get(input.second.ptr) == input.second.slot)
+                inputs.emplace_back(&input.first, input.second.ptr);
+        writer.writeUint(inputs.size());
+        for (auto const & input : inputs) {
+            writer.writeString(*input.first);
+            writer.writeUint(input.second);
+        }
+
+        /* Outputs freed by the bytecode are saved separately: */
+        writer.writeUint(m_ioBuffers->outputs.size());
+        for (auto const & output : m_ioBuffers->outputs) {
+            writer.writeString(output.first);
+            auto const it(slotPtrs.find(output.second.get()));
+            if (it != slotPtrs.end()) {
+                writer.writeUint(it->second);
+            } else {
+                writer.writeUint(0u);
+                writer.writeUint(output.second->size());
+                writer.write(output.second->data(), output.second->size());
+            }
+        }
+    } else {
+        writer.writeUint(0u);
+        writer.writeUint(0u);
+    }
+
+    writer.write(checkpointMagic, sizeof(checkpointMagic));
+    m_checkpointState = std::move(newState);
+}
+
+void ProcessState::readCheckpoint(std::istream & is,
+                                  ProcessState const * const base)
+{
+    assert(m_state == State::Initialized);
+    assert(base != this);
+    CheckpointReader reader(is);
+
+    reader.readMagic();
+    if (reader.readUint() != checkpointVersion)
+        throw Process::InvalidCheckpointException();
+    auto const flags = reader.readUint();
+    if (flags & ~CheckpointIncremental)
+        throw Process::InvalidCheckpointException();
+    std::unique_ptr<CheckpointState> newState(
+                new CheckpointState{reader.readUint(), {}});
+    if (!newState->id)
+        throw Process::InvalidCheckpointException();
+    auto const baseId = reader.readUint();
+    if (!baseId != !(flags & CheckpointIncremental))
+        throw Process::InvalidCheckpointException();
+    if (baseId && (!base
+                   || !base->m_checkpointState
+                   || (base->m_checkpointState->id != baseId)))
+        throw Process::CheckpointBaseMismatchException();
+
+    auto const & unit = *m_preparedLinkingUnit;
+    if ((reader.readUint() != m_activeLinkingUnitIndex)
+        || (reader.readUint() != unit.codeSection.size())
+        || (reader.readUint() != unit.rwDataSection.size())
+        || (reader.readUint() != unit.bssSectionSize)
+        || (reader.readDigest() != hashRoData(unit)))
+        throw Process::InvalidCheckpointException();
+
+    State state;
+    switch (reader.readUint()) {
+    case 0u: state = State::Initialized; break;
+    case 1u: state = State::Trapped; break;
+    default: throw Process::InvalidCheckpointException();
+    }
+    auto const & codeSection = unit.codeSection;
+    m_currentIp = reader.readSize();
+    if (!codeSection.isExecutableOffset(m_currentIp))
+        throw Process::InvalidCheckpointException();
+    reader.read(&m_returnValue, sizeof(m_returnValue));
+    m_fpuState = static_cast<sf_fpu_state>(reader.readUint());
+
+    /* Keep the limits of this process and account for the memory restored: */
+    assert(!m_memPublicHeap.usage && !m_memPrivate.usage
+           && !m_memReserved.usage && !m_memTotal.usage);
+    {
+        auto const reserved = reader.readSize();
+        if ((m_memReserved.upperLimit < reserved)
+            || (m_memTotal.upperLimit < reserved))
+            throw Process::CheckpointMemoryLimitException();
+        m_memReserved.usage = reserved;
+        m_memTotal.usage = reserved;
+    }
+    for (auto * const memInfo
+         : {&m_memPublicHeap, &m_memPrivate, &m_memReserved, &m_memTotal})
+        memInfo->max = std::max(reader.readSize(), memInfo->usage);
+    auto const accountSlot =
+            [this](std::size_t const size) {
+                if ((m_memTotal.upperLimit - m_memTotal.usage < size)
+                    || (m_memPublicHeap.upperLimit - m_memPublicHeap.usage
+                        < size))
+                    throw Process::CheckpointMemoryLimitException();
+                addPublicMemoryUsage(size);
+            };
+
+    for (auto numSlots = reader.readUint(); numSlots; --numSlots) {
+        auto const ptr = reader.readUint();
+        auto const size = reader.readSize();
+        auto const hash = reader.readDigest();
+        auto const slotFlags = reader.readUint();
+        if ((ptr < 2u)
+            || (slotFlags & ~(SlotWritable | SlotUnchanged))
+            || !newState->slotHashes.emplace(ptr, hash).second)
+            throw Process::InvalidCheckpointException();
+
+        /* Unchanged slots must still be unchanged in the base process: */
+        MemoryMap::ValueType source;
+        if (slotFlags & SlotUnchanged) {
+            if (!baseId)
+                throw Process::InvalidCheckpointException();
+            source = base->m_memoryMap.get(ptr);
+            if (!source || (hashSlot(*source) != hash))
+                throw Process::CheckpointBaseMismatchException();
+        }
+
+        /* The data sections are restored in place: */
+        if (ptr < MemoryMap::numReservedPointers) {
+            auto const & slot = m_memoryMap.get(ptr);
+            if (!slot || (slot->size() != size))
+                throw Process::InvalidCheckpointException();
+            if (source) {
+                std::memcpy(slot->data(), source->data(), size);
+            } else {
+                reader.read(slot->data(), size);
+            }
+            continue;
+        }
+
+        accountSlot(size);
+        MemoryMap::ValueType slot;
+        if (!source)
+            reader.require(size);
+        if (source) {
+            /* Share read-only memory, like clones do: */
+            if (slotFlags & SlotWritable) {
+                slot = source->clone();
+            } else {
+                slot = std::move(source);
+            }
+        } else if (slotFlags & SlotWritable) {
+            auto memory(std::make_shared<PublicMemory>(size));
+            reader.read(memory->data(), size);
+            slot = std::move(memory);
+        } else {
+            std::shared_ptr<char> data(new char[size],
+                                       std::default_delete<char[]>());
+            reader.read(data.get(), size);
+            slot = std::make_shared<InputMemory>(std::move(data), size);
+        }
+        if (!m_memoryMap.insertAt(ptr, std::move(slot)))
+            throw Process::InvalidCheckpointException();
+    }
+
+    if (auto numSegments = reader.readUint()) {
+        auto & segments = ioBuffers().sharedSegments;
+        for (; numSegments; --numSegments) {
+            auto name(reader.readString());
+            auto const ptr = reader.readUint();
+            auto const size = reader.readSize();
+            if (ptr < MemoryMap::numReservedPointers)
+                throw Process::InvalidCheckpointException();
+            auto slot(m_programState->sharedSegment(name));
+            if (!slot || (slot->size() != size))
+                throw Process::CheckpointSharedSegmentMismatchException();
+            /* Like when mapped, segments are not subject to the limits: */
+            addPublicMemoryUsage(size);
+            if (!m_memoryMap.insertAt(ptr, slot)
+                || !segments.emplace(std::move(name),
+                                     Input{ptr, std::move(slot)}).second)
+                throw Process::InvalidCheckpointException();
+        }
+    }
+
+    std::vector<StackFrame *> frames;
+    std::uint64_t thisIndex;
+    std::uint64_t nextIndex;
+    {
+        auto const numFrames = reader.readUint();
+        thisIndex = reader.readUint();
+        nextIndex = reader.readUint();
+        if (!numFrames
+            || (thisIndex >= numFrames)
+            || ((nextIndex >= numFrames) && (nextIndex != noIndex)))
+            throw Process::InvalidCheckpointException();
+        /* Each frame takes at least its return address and stack size: */
+        reader.require(numFrames, 2u * sizeof(std::uint64_t));
+
+        /* Reuse the global frame: */
+        assert(m_frames.size() == 1u);
+        frames.emplace_back(m_globalFrame);
+        for (auto i = numFrames - 1u; i; --i) {
+            m_frames.emplace_back();
+            frames.emplace_back(&m_frames.back());
+        }
+    }
+    m_thisFrame = frames[thisIndex];
+    m_nextFrame = (nextIndex != noIndex) ? frames[nextIndex] : nullptr;
+
+    for (auto * const frame : frames) {
+        auto const returnAddr = reader.readUint();
+        if (returnAddr == noIndex) {
+            frame->returnAddr = nullptr;
+        } else if ((returnAddr <= codeSection.size())
+                   && codeSection.isReturnAddress(
+                          static_cast<std::size_t>(returnAddr)))
+        {
+            frame->returnAddr = codeSection.constData() + returnAddr;
+        } else {
+            throw Process::InvalidCheckpointException();
+        }
+        auto const stackSize = reader.readSize();
+        reader.require(stackSize, sizeof(SharemindCodeBlock));
+        frame->stack.resize(stackSize);
+        reader.read(frame->stack.data(),
+                    frame->stack.size() * sizeof(SharemindCodeBlock));
+    }
+    if (m_globalFrame->returnAddr)
+        throw Process::InvalidCheckpointException();
+
+    /*
+      Locations written through (return values and references) must be in
+      writable slots or stack frames, not in read-only memory such as RODATA,
+      inputs or shared segments:
+    */
+    auto const readLocation =
+            [this, &reader, &frames](std::size_t const size,
+                                     bool const writable)
+            {
+                auto const kind = reader.readUint();
+                auto const id = reader.readUint();
+                auto const offset = reader.readUint();
+                DecodedLocation r{nullptr, nullptr};
+                std::size_t available;
+                switch (kind) {
+                case NullLocation:
+                    return r;
+                case SlotLocation:
+                    r.owner = m_memoryMap.get(id);
+                    if (!r.owner || (writable && !r.owner->isWritable()))
+                        throw Process::InvalidCheckpointException();
+                    r.ptr = r.owner->data();
+                    available = r.owner->size();
+                    break;
+                case StackLocation:
+                    if (id >= frames.size())
+                        throw Process::InvalidCheckpointException();
+                    r.ptr = frames[id]->stack.data();
+                    available = frames[id]->stack.size()
+                                * sizeof(SharemindCodeBlock);
+                    break;
+                default:
+                    throw Process::InvalidCheckpointException();
+                }
+                if ((offset > available) || (size > available - offset))
+                    throw Process::InvalidCheckpointException();
+                r.ptr = static_cast<char *>(r.ptr) + offset;
+                return r;
+            };
+
+    for (auto * const frame : frames) {
+        frame->returnValueAddr =
+                static_cast<SharemindCodeBlock *>(
+                    readLocation(sizeof(SharemindCodeBlock), true).ptr);
+        for (auto numRefs = reader.readUint(); numRefs; --numRefs) {
+            auto const size = reader.readSize();
+            auto location(readLocation(size, true));
+            frame->refstack.emplace_back(
+                        std::shared_ptr<void>(std::move(location.owner),
+                                              location.ptr),
+                        size);
+        }
+        for (auto numCrefs = reader.readUint(); numCrefs; --numCrefs) {
+            auto const size = reader.readSize();
+            auto location(readLocation(size, false));
+            frame->crefstack.emplace_back(
+                        std::shared_ptr<void const>(std::move(location.owner),
+                                                    location.ptr),
+                        size);
+        }
+    }
+
+    if (auto numInputs = reader.readUint()) {
+        auto & inputs = ioBuffers().inputs;
+        for (; numInputs; --numInputs) {
+            auto name(reader.readString());
+            auto const ptr = reader.readUint();
+            auto const & slot = m_memoryMap.get(ptr);
+            if (!slot)
+                throw Process::InvalidCheckpointException();
+            inputs[std::move(name)] = Input{ptr, slot};
+        }
+    }
+    if (auto numOutputs = reader.readUint()) {
+        auto & outputs = ioBuffers().outputs;
+        for (; numOutputs; --numOutputs) {
+            auto name(reader.readString());
+            MemoryMap::ValueType slot;
+            if (auto const ptr = reader.readUint()) {
+                slot = m_memoryMap.get(ptr);
+                if (!slot)
+                    throw Process::InvalidCheckpointException();
+            } else {
+                auto const size = reader.readSize();
+                reader.require(size);
+                auto memory(std::make_shared<PublicMemory>(size));
+                reader.read(memory->data(), memory->size());
+                slot = std::move(memory);
+            }
+            outputs[std::move(name)] = std::move(slot);
+        }
+    }
+
+    reader.readMagic();
+    m_checkpointState = std::move(newState);
+    m_state.store(state, std::memory_order_release);
+}
+
+} /* namespace Detail { */
+} /* namespace sharemind { */
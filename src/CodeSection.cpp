@@ -21,9 +21,10 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <limits>
 #include <new>
-#include <sharemind/DebugOnly.h>
+#include <unordered_map>
 
 
 namespace sharemind {
@@ -41,26 +42,82 @@ CodeSection::CodeSection(std::vector<SharemindCodeBlock> data)
 
 CodeSection::~CodeSection() noexcept {}
 
-bool CodeSection::isInstructionAtOffset(std::size_t const offset) const noexcept
-{ return (offset < m_instrmap.size()) && m_instrmap[offset]; }
-
 void CodeSection::registerInstruction(
         std::size_t const offset,
         std::size_t const instructionBlockIndex,
         VmInstructionInfo const & description)
 {
     assert(!m_instrmap[offset]);
+    assert(instructionBlockIndex == m_instructions.size());
+    static_cast<void>(instructionBlockIndex);
     m_instrmap[offset] = true;
-    SHAREMIND_DEBUG_ONLY(auto const r =)
-            m_blockmap.emplace(instructionBlockIndex, description);
-    assert(r.second);
+    m_instructions.emplace_back(&description);
 }
 
-VmInstructionInfo const * CodeSection::instructionDescriptionAtOffset(
-        std::size_t const offset) const noexcept
+std::size_t CodeSection::nextInstructionOffset(std::size_t offset)
+        const noexcept
 {
-    auto const it(m_blockmap.find(offset));
-    return (it != m_blockmap.end()) ? &it->second : nullptr;
+    assert(isInstructionAtOffset(offset));
+    auto const end(m_instrmap.end());
+    auto const it(std::find(m_instrmap.begin() + (offset + 1u), end, true));
+    return static_cast<std::size_t>(it - m_instrmap.begin());
+}
+
+bool CodeSection::isReturnAddress(std::size_t const offset) const noexcept {
+    if (!offset || !isExecutableOffset(offset))
+        return false;
+
+    /* Find the instruction preceding the offset: */
+    auto const begin(m_instrmap.begin());
+    auto it(begin + static_cast<std::ptrdiff_t>(offset));
+    do {
+        if (it == begin)
+            return false;
+    } while (!*--it);
+    auto const callOffset = static_cast<std::size_t>(it - begin);
+    auto const * const info =
+            instructionDescriptionAtOffset(
+                instructionIndexAtOffset(callOffset));
+    assert(info);
+
+    /* The instruction names of LibVmi are namespaced, e.g. "common.proc.": */
+    static constexpr char const callPrefix[] = "common.proc.call";
+    return (callOffset + 1u + info->numArgs == offset)
+           && (std::strncmp(info->fullName,
+                            callPrefix,
+                            sizeof(callPrefix) - 1u) == 0);
+}
+
+std::size_t CodeSection::instructionIndexAtOffset(std::size_t const offset)
+        const noexcept
+{
+    auto const begin(m_instrmap.begin());
+    return static_cast<std::size_t>(
+                std::count(begin,
+                           begin + std::min(offset, m_instrmap.size()),
+                           true));
+}
+
+void CodeSection::enableOpcodeCounting() {
+    assert(!m_opcodeCounting);
+    auto const codeSize = size();
+    auto counting(std::make_shared<OpcodeCounting>());
+    counting->handlers.assign(m_data.begin(), m_data.begin() + codeSize);
+    counting->opcodes.resize(codeSize, 0u);
+
+    std::unordered_map<VmInstructionInfo const *, std::uint32_t> opcodes;
+    std::size_t instructionIndex = 0u;
+    for (std::size_t offset = 0u; offset < codeSize; ++offset) {
+        if (!m_instrmap[offset])
+            continue;
+        assert(instructionIndex < m_instructions.size());
+        auto const * const info = m_instructions[instructionIndex++];
+        auto const r(opcodes.emplace(info, counting->infos.size()));
+        if (r.second)
+            counting->infos.emplace_back(info);
+        counting->opcodes[offset] = r.first->second;
+    }
+    m_opcodeCounting = std::move(counting);
 }
 
 } // namespace Detail {
@@ -24,10 +24,12 @@
 #error including an internal header!
 #endif
 
+#include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <sharemind/codeblock.h>
 #include <sharemind/libvmi/instr.h>
-#include <unordered_map>
 #include <vector>
 #include <utility>
 
@@ -49,14 +51,53 @@ public: /* Methods: */
     CodeSection & operator=(CodeSection &&) = default;
     CodeSection & operator=(CodeSection const &) = default;
 
-    bool isInstructionAtOffset(std::size_t const offset) const noexcept;
+    bool isInstructionAtOffset(std::size_t const offset) const noexcept
+    { return (offset < m_instrmap.size()) && m_instrmap[offset]; }
 
+    /**
+      \brief Registers the instruction at the given offset.
+      \pre Instructions are registered in order of their offsets, hence
+           instructionBlockIndex must equal the number of instructions
+           registered before.
+    */
     void registerInstruction(std::size_t const offset,
                              std::size_t const instructionBlockIndex,
                              VmInstructionInfo const & description);
 
     VmInstructionInfo const * instructionDescriptionAtOffset(
-            std::size_t const offset) const noexcept;
+            std::size_t const offset) const noexcept
+    {
+        return (offset < m_instructions.size())
+               ? m_instructions[offset]
+               : nullptr;
+    }
+
+    /**
+      \returns the number of instructions before the given offset, i.e. the
+               index of the instruction at the offset if there is one.
+    */
+    std::size_t instructionIndexAtOffset(std::size_t const offset)
+            const noexcept;
+
+    /**
+      \returns the offset of the instruction following the instruction at the
+               given offset, or size() if there is none.
+    */
+    std::size_t nextInstructionOffset(std::size_t offset) const noexcept;
+
+    /**
+      \returns whether execution may continue at the given offset, i.e.
+               whether there is an instruction at the offset or the offset
+               is that of the terminator at the end of the section.
+    */
+    bool isExecutableOffset(std::size_t const offset) const noexcept
+    { return (offset == size()) || isInstructionAtOffset(offset); }
+
+    /**
+      \returns whether the given offset directly follows a call instruction,
+               i.e. whether it is a valid return address of a stack frame.
+    */
+    bool isReturnAddress(std::size_t const offset) const noexcept;
 
     SharemindCodeBlock * data() noexcept { return m_data.data(); }
 
@@ -65,11 +106,74 @@ public: /* Methods: */
 
     std::size_t size() const noexcept { return m_data.size() - 1u; }
 
+    /**
+      \brief Remembers the prepared code blocks of all instructions, so that
+             their dispatch pointers can be replaced with a counting
+             trampoline which dispatches to countedHandler() after counting.
+      \pre All instructions have been registered and prepared.
+    */
+    void enableOpcodeCounting();
+
+    bool countsOpcodes() const noexcept
+    { return static_cast<bool>(m_opcodeCounting); }
+
+    /** \returns the number of distinct instructions in this section. */
+    std::size_t numCountedOpcodes() const noexcept {
+        assert(m_opcodeCounting);
+        return m_opcodeCounting->infos.size();
+    }
+
+    /**
+      \returns the index (less than numCountedOpcodes()) of the instruction
+               at the given offset among the distinct instructions.
+    */
+    std::uint32_t countedOpcode(std::size_t const offset) const noexcept {
+        assert(m_opcodeCounting);
+        assert(isInstructionAtOffset(offset));
+        return m_opcodeCounting->opcodes[offset];
+    }
+
+    VmInstructionInfo const & countedOpcodeInfo(std::uint32_t const opcode)
+            const noexcept
+    {
+        assert(m_opcodeCounting);
+        assert(opcode < m_opcodeCounting->infos.size());
+        return *m_opcodeCounting->infos[opcode];
+    }
+
+    /** \returns the prepared code block of the instruction at the offset. */
+    SharemindCodeBlock const & countedHandler(std::size_t const offset)
+            const noexcept
+    {
+        assert(m_opcodeCounting);
+        assert(isInstructionAtOffset(offset));
+        return m_opcodeCounting->handlers[offset];
+    }
+
+private: /* Types: */
+
+    struct OpcodeCounting {
+
+    /* Fields: */
+
+        /// The prepared code blocks of the instructions by offset:
+        std::vector<SharemindCodeBlock> handlers;
+        /// The opcode indexes of the instructions by offset:
+        std::vector<std::uint32_t> opcodes;
+        /// The distinct instructions by opcode index:
+        std::vector<VmInstructionInfo const *> infos;
+
+    };
+
 private: /* Fields: */
 
     std::vector<SharemindCodeBlock> m_data;
+    /// A bitmap of instruction starts indexed by code block offset:
     std::vector<bool> m_instrmap;
-    std::unordered_map<std::size_t, VmInstructionInfo const &> m_blockmap;
+    /// Instruction descriptions indexed by instruction index:
+    std::vector<VmInstructionInfo const *> m_instructions;
+    /// Set only if opcode counting is enabled:
+    std::shared_ptr<OpcodeCounting const> m_opcodeCounting;
 
 };
 
@@ -241,20 +241,18 @@ void SHAREMIND_MI_BNEG_FLOAT64(T & d, T2 const & s) { d = sf_float64_neg(s); }
 #define SHAREMIND_MI_CONVERT_uint64_TO_float64(d,v) \
     (d) = SHAREMIND_SF_E(sf_uint64_to_float64, (v))
 
-#ifndef SHAREMIND_FAST_BUILD
-#define SHAREMIND_DO_HALT   do { return; } while ((0))
-#define SHAREMIND_DO_TRAP   do { throw Process::TrapException(); } while ((0))
-#else
-enum class HaltCode { Continue, Halt };
-#define SHAREMIND_DO_HALT   do { return HaltCode::Halt;   } while ((0))
-#define SHAREMIND_DO_TRAP   do { throw Process::TrapException(); } while ((0))
-#endif
-
 #define SHAREMIND_UPDATESTATE \
     do { \
         p->m_currentIp = static_cast<std::size_t>(ip - codeStart); \
     } while ((0))
 
+#define SHAREMIND_DO_HALT   do { return VmRunResult::Halted; } while ((0))
+#define SHAREMIND_DO_TRAP \
+    do { \
+        SHAREMIND_UPDATESTATE; \
+        return VmRunResult::Trapped; \
+    } while ((0))
+
 /* Micro-instructions (SHAREMIND_MI_*:) */
 
 #define SHAREMIND_MI_NOP (void) 0
@@ -274,29 +272,45 @@ enum class HaltCode { Continue, Halt };
     do { \
         (void) (ip); \
         SHAREMIND_UPDATESTATE; \
-        return HaltCode::Continue; \
+        return VmRunResult::Continue; \
     } while ((0))
 #define SHAREMIND_MI_DISPATCH(ip) \
     do { \
         (void) (ip); \
         SHAREMIND_UPDATESTATE; \
-        return HaltCode::Continue; \
+        return VmRunResult::Continue; \
     } while ((0))
 #endif
 
-#define SHAREMIND_TRAP_CHECK \
-    (p->m_trapCond.exchange(false, std::memory_order_acquire))
-
-#define SHAREMIND_CHECK_TRAP \
-    if (SHAREMIND_TRAP_CHECK) { SHAREMIND_DO_TRAP; } else (void) 0
+/*
+  Preemption points are only at backward jumps, calls and system calls, which
+  bounds the number of instructions executed between them. Each point uses one
+  unit of fuel and checks the attention bits with a relaxed load, taking the
+  slow path in ProcessState::handleAttention() only when needed. The state is
+  updated beforehand, so that resuming continues at the target instruction.
+*/
+#define SHAREMIND_ATTENTION_CHECK \
+    (unlikely((--p->m_fuel == 0u) \
+              | (p->m_attention.load(std::memory_order_relaxed) != 0u)))
+
+#define SHAREMIND_CHECK_ATTENTION \
+    if (SHAREMIND_ATTENTION_CHECK) { \
+        SHAREMIND_UPDATESTATE; \
+        auto const attentionResult = p->handleAttention(); \
+        if (attentionResult != VmRunResult::Continue) \
+            return attentionResult; \
+    } else (void) 0
 
-#define SHAREMIND_CHECK_TRAP_AND_DISPATCH(ip) \
-    do { SHAREMIND_CHECK_TRAP; SHAREMIND_DISPATCH((ip)); } while ((0))
+#define SHAREMIND_CHECK_ATTENTION_AND_DISPATCH(ip) \
+    do { SHAREMIND_CHECK_ATTENTION; SHAREMIND_DISPATCH((ip)); } while ((0))
 
 #define SHAREMIND_MI_JUMP_REL(n) \
     do { \
         ip += (n)->int64[0]; \
-        SHAREMIND_CHECK_TRAP_AND_DISPATCH(ip); \
+        if ((n)->int64[0] <= 0) { \
+            SHAREMIND_CHECK_ATTENTION; \
+        } \
+        SHAREMIND_DISPATCH(ip); \
     } while ((0))
 
 #define SHAREMIND_MI_IS_INSTR(i) \
@@ -320,13 +334,17 @@ enum class HaltCode { Continue, Halt };
         if (unlikely(!SHAREMIND_MI_IS_INSTR(tip - codeStart))) \
             throw Process::JumpToInvalidAddressException(); \
         ip = tip; \
-        SHAREMIND_CHECK_TRAP_AND_DISPATCH(ip); \
+        if ((reladdr) <= 0) { \
+            SHAREMIND_CHECK_ATTENTION; \
+        } \
+        SHAREMIND_DISPATCH(ip); \
     } while ((0))
 
 #define SHAREMIND_MI_DO_USER_EXCEPT(e) \
     do { \
-        p->m_userException.setErrorCode((e)); \
-        throw Process::UserDefinedException(std::move(p->m_userException)); \
+        Process::UserDefinedException userException; \
+        userException.setErrorCode((e)); \
+        throw userException; \
     } while ((0))
 
 #define SHAREMIND_MI_DO_USER_EXCEPT_WITH_MESSAGE \
@@ -334,8 +352,9 @@ enum class HaltCode { Continue, Halt };
         if ((!SHAREMIND_MI_HAS_STACK) || p->m_nextFrame->crefstack.empty()) \
             throw Process::InvalidArgumentException(); \
         auto const & cref = p->m_nextFrame->crefstack.front(); \
-        p->m_userException.setUserErrorMessage(cref.data.get(), cref.size); \
-        throw Process::UserDefinedException(std::move(p->m_userException)); \
+        Process::UserDefinedException userException; \
+        userException.setUserErrorMessage(cref.data.get(), cref.size); \
+        throw userException; \
     } while ((0))
 
 #define SHAREMIND_MI_DO_EXCEPT(e) \
@@ -455,16 +474,14 @@ std::uint8_t const emptyCReferenceTarget = 0u;
 #define SHAREMIND_MI_HAS_STACK (!!(p->m_nextFrame))
 
 #ifndef SHAREMIND_FAST_BUILD
-#define SHAREMIND_CALL_RETURN_DISPATCH(ip) \
+#define SHAREMIND_UPDATE_FRAME_POINTERS \
     do { \
-        thisStack = &p->thisFrame->stack; \
-        thisRefStack = &p->thisFrame->refstack; \
-        thisCRefStack = &p->thisFrame->crefstack; \
-        SHAREMIND_CHECK_TRAP_AND_DISPATCH((ip)); \
+        thisStack = &p->m_thisFrame->stack; \
+        thisRefStack = &p->m_thisFrame->refstack; \
+        thisCRefStack = &p->m_thisFrame->crefstack; \
     } while ((0))
 #else
-#define SHAREMIND_CALL_RETURN_DISPATCH(ip) \
-    SHAREMIND_CHECK_TRAP_AND_DISPATCH((ip))
+#define SHAREMIND_UPDATE_FRAME_POINTERS (void) 0
 #endif
 
 #define SHAREMIND_MI_CALL(a,r,nargs) \
@@ -475,7 +492,8 @@ std::uint8_t const emptyCReferenceTarget = 0u;
         p->m_thisFrame = p->m_nextFrame; \
         p->m_nextFrame = nullptr; \
         ip = codeStart + static_cast<std::size_t>((a)); \
-        SHAREMIND_CALL_RETURN_DISPATCH(ip); \
+        SHAREMIND_UPDATE_FRAME_POINTERS; \
+        SHAREMIND_CHECK_ATTENTION_AND_DISPATCH(ip); \
     } while ((0))
 
 #define SHAREMIND_MI_CHECK_CALL(a,r,nargs) \
@@ -496,14 +514,34 @@ std::uint8_t const emptyCReferenceTarget = 0u;
                      (r), \
                      p->m_syscallContext); \
         } catch (...) { \
+            if (p->m_pendingSyscall) \
+                p->abandonPendingSyscall(); \
             p->m_frames.pop_back(); \
             p->m_nextFrame = nullptr; \
             p->m_syscallException = std::current_exception(); \
             std::throw_with_nested(Process::SystemCallErrorException()); \
         } \
+        if (unlikely(p->m_pendingSyscall)) { \
+            /* Keep the frame, continue after the syscall when resumed: */ \
+            p->m_pendingSyscallReturnValueAddr = (r); \
+            ip = codeStart + p->currentCodeSection().nextInstructionOffset( \
+                        static_cast<std::size_t>(ip - codeStart)); \
+            SHAREMIND_UPDATESTATE; \
+            return VmRunResult::Suspended; \
+        } \
         p->m_frames.pop_back(); \
         p->m_nextFrame = nullptr; \
-        SHAREMIND_CHECK_TRAP; \
+        if (SHAREMIND_ATTENTION_CHECK) { \
+            /* Continue after the syscall when resumed: */ \
+            auto const syscallIp = ip; \
+            ip = codeStart + p->currentCodeSection().nextInstructionOffset( \
+                        static_cast<std::size_t>(ip - codeStart)); \
+            SHAREMIND_UPDATESTATE; \
+            auto const attentionResult = p->handleAttention(); \
+            if (attentionResult != VmRunResult::Continue) \
+                return attentionResult; \
+            ip = syscallIp; \
+        } \
     } while ((0))
 
 #define SHAREMIND_MI_SYSCALL(a,r) \
@@ -532,7 +570,8 @@ std::uint8_t const emptyCReferenceTarget = 0u;
             ip = p->m_thisFrame->returnAddr; \
             p->m_frames.pop_back(); \
             p->m_thisFrame = &p->m_frames.back(); \
-            SHAREMIND_CALL_RETURN_DISPATCH(ip); \
+            SHAREMIND_UPDATE_FRAME_POINTERS; \
+            SHAREMIND_DISPATCH(ip); \
         } else { \
             SHAREMIND_MI_HALT((r)); \
         } \
@@ -637,7 +676,7 @@ inline void publicFree(ProcessState & p, SharemindCodeBlock const & ptr) {
     label_impl_ ## name : __VA_ARGS__
 #else
 #define SHAREMIND_IMPL_INNER(name,...) \
-    inline HaltCode name(ProcessState * const p) { \
+    inline VmRunResult name(ProcessState * const p) { \
         auto const codeStart = p->currentCodeSection().constData();\
         SharemindCodeBlock const * ip = &codeStart[p->m_currentIp]; \
         auto * const globalStack = &p->m_globalFrame->stack; \
@@ -654,17 +693,26 @@ inline void publicFree(ProcessState & p, SharemindCodeBlock const & ptr) {
 
 SHAREMIND_IMPL_INNER(_func_impl_eof,
                      throw Process::JumpToInvalidAddressException();)
+
+/* The opcode counting trampoline, see CodeSection::countedHandler(): */
+VmRunResult _func_count_opcode(ProcessState * const p) {
+    p->countOpcode(p->m_currentIp);
+    using ImplFunctionType = VmRunResult (*)(ProcessState * const p);
+    return (*(reinterpret_cast<ImplFunctionType>(
+                  p->currentCodeSection().countedHandler(
+                      p->m_currentIp).fp[0])))(p);
+}
 #endif
 
 } // anonymous namespace
 
 
-void vmRun(ExecuteMethod const sharemind_vm_run_command,
-           void * const sharemind_vm_run_data)
+VmRunResult vmRun(ExecuteMethod const sharemind_vm_run_command,
+                  void * const sharemind_vm_run_data)
 {
     assert(sharemind_vm_run_data);
     #ifdef SHAREMIND_FAST_BUILD
-    using ImplLabelType = HaltCode (*)(ProcessState * const p);
+    using ImplLabelType = VmRunResult (*)(ProcessState * const p);
     #endif
     if (sharemind_vm_run_command == ExecuteMethod::GetInstruction) {
 #ifndef SHAREMIND_FAST_BUILD
@@ -674,12 +722,14 @@ void vmRun(ExecuteMethod const sharemind_vm_run_command,
 #define SHAREMIND_IMPL_LABEL(name) && label_impl_ ## name ,
 #include <sharemind/m4/static_label_structs.h>
         static ImplLabelType const eofLabel = && eof;
+        static ImplLabelType const countingLabel = && count_opcode;
 #else
 #define SHAREMIND_CBPTR fp
         using CbPtrType = void (*)(void);
 #define SHAREMIND_IMPL_LABEL(name) & func_impl_ ## name ,
 #include <sharemind/m4/static_label_structs.h>
         static ImplLabelType const eofLabel = &_func_impl_eof;
+        static ImplLabelType const countingLabel = &_func_count_opcode;
 #endif
 
         auto * pb = static_cast<PreparationBlock *>(sharemind_vm_run_data);
@@ -693,8 +743,12 @@ void vmRun(ExecuteMethod const sharemind_vm_run_command,
                 pb->block->SHAREMIND_CBPTR[0] =
                         reinterpret_cast<CbPtrType>(eofLabel);
                 break;
+            case PreparationBlock::CountingLabel:
+                pb->block->SHAREMIND_CBPTR[0] =
+                        reinterpret_cast<CbPtrType>(countingLabel);
+                break;
         }
-        return;
+        return VmRunResult::Continue;
 
     } else {
         assert(sharemind_vm_run_command == ExecuteMethod::Run
@@ -709,32 +763,44 @@ void vmRun(ExecuteMethod const sharemind_vm_run_command,
         auto const codeStart = p->currentCodeSection().constData();
 
 #ifndef SHAREMIND_FAST_BUILD
-        SharemindCodeBlock const * ip = &codeStart[p->currentIp];
-        auto * const globalStack = &p->globalFrame->stack;
-        auto * thisStack = &p->thisFrame->stack;
-        auto * thisRefStack = &p->thisFrame->refstack;
-        auto * thisCRefStack = &p->thisFrame->crefstack;
+        SharemindCodeBlock const * ip = &codeStart[p->m_currentIp];
+        auto * const globalStack = &p->m_globalFrame->stack;
+        auto * thisStack = &p->m_thisFrame->stack;
+        auto * thisRefStack = &p->m_thisFrame->refstack;
+        auto * thisCRefStack = &p->m_thisFrame->crefstack;
 #endif
 
-        if (SHAREMIND_TRAP_CHECK)
-            throw Process::TrapException();
+        if (!p->m_fuel || p->m_attention.load(std::memory_order_relaxed)) {
+            auto const attentionResult = p->handleAttention();
+            if (attentionResult != VmRunResult::Continue)
+                return attentionResult;
+        }
 
 #ifndef SHAREMIND_FAST_BUILD
         try {
             SHAREMIND_MI_DISPATCH(ip);
 
             #include <sharemind/m4/dispatches.h>
+
+            /* The opcode counting trampoline: */
+            count_opcode:
+            {
+                auto const offset = static_cast<std::size_t>(ip - codeStart);
+                p->countOpcode(offset);
+                SHAREMIND_DISPATCH(
+                        &p->currentCodeSection().countedHandler(offset));
+            }
         } catch (...) {
             SHAREMIND_UPDATESTATE;
             throw;
         }
 #else
-        HaltCode r;
+        VmRunResult r;
         do {
             r = (*(reinterpret_cast<ImplLabelType>(
                        codeStart[p->m_currentIp].fp[0])))(p);
-            assert(r == HaltCode::Halt || r == HaltCode::Continue);
-        } while (r == HaltCode::Continue);
+        } while (r == VmRunResult::Continue);
+        return r;
 #endif
     }
 }
@@ -30,7 +30,18 @@ namespace Detail {
 
 enum class ExecuteMethod { GetInstruction, Run, Continue };
 
-void vmRun(ExecuteMethod const c, void * d)
+/** \brief The reason why vmRun() stopped executing a process. */
+enum class VmRunResult {
+    Continue, ///< Used only internally by the fast build and by GetInstruction
+    Halted,
+    Trapped,
+    FuelExhausted,
+    Suspended,
+    Held,
+    Cancelled
+};
+
+VmRunResult vmRun(ExecuteMethod const c, void * d)
     __attribute__((
          #if __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ > 5 )
          noclone,
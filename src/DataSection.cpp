@@ -20,34 +20,60 @@
 #include "DataSection.h"
 
 
+#include <cassert>
+#include <cstdint>
 #include <cstring>
+#include <limits>
 #include <new>
 #include <sharemind/AssertReturn.h>
+#include <sharemind/GlobalDeleter.h>
 
 
 namespace sharemind {
 namespace Detail {
 
+namespace {
+
+std::shared_ptr<void> allocateSectionData(std::size_t const size) {
+    if (!size)
+        return nullptr;
+    return std::shared_ptr<void>(::operator new(size), GlobalDeleter());
+}
+
+std::shared_ptr<void> allocateMemory(std::size_t const size)
+{ return std::shared_ptr<void>(::operator new(size), GlobalDeleter()); }
+
+std::size_t cacheLineStride(std::size_t const size) noexcept
+{ return (size + cacheLineSize - 1u) / cacheLineSize * cacheLineSize; }
+
+} // anonymous namespace
+
 BssDataSection::BssDataSection(BssDataSection &&) noexcept = default;
 
 BssDataSection::BssDataSection(BssDataSection const & copy)
     : MemorySlot()
-    , m_data(::operator new(copy.m_size))
+    , m_data(allocateMemory(copy.m_size))
     , m_size(copy.m_size)
 { std::memcpy(m_data.get(), copy.m_data.get(), m_size); }
 
 BssDataSection::BssDataSection(std::size_t const size)
-    : m_data(::operator new(size))
+    : m_data(allocateMemory(size))
     , m_size(size)
 { std::memset(data(), 0, size); }
 
+BssDataSection::BssDataSection(std::shared_ptr<void> data,
+                               std::size_t const size)
+    : m_data(assertReturn(std::move(data)))
+    , m_size(size)
+{ std::memset(m_data.get(), 0, size); }
+
 BssDataSection::~BssDataSection() noexcept = default;
 
 BssDataSection & BssDataSection::operator=(BssDataSection &&) noexcept =
         default;
 
 BssDataSection & BssDataSection::operator=(BssDataSection const & copy) {
-    decltype(m_data) newData(::operator new(copy.m_size));
+    auto newData(allocateMemory(copy.m_size));
     std::memcpy(newData.get(), copy.m_data.get(), m_size);
     m_data = std::move(newData);
     m_size = copy.m_size;
@@ -58,26 +84,58 @@ void * BssDataSection::data() const noexcept { return m_data.get(); }
 
 std::size_t BssDataSection::size() const noexcept { return m_size; }
 
+std::shared_ptr<MemorySlot> BssDataSection::clone() const
+{ return std::make_shared<BssDataSection>(*this); }
 
 
 RwDataSection::RwDataSection(RwDataSection &&) noexcept = default;
 
-RwDataSection::RwDataSection(RwDataSection const &) = default;
+RwDataSection::RwDataSection(RwDataSection const & copy)
+    : MemorySlot()
+    , m_data(allocateSectionData(copy.m_size))
+    , m_size(copy.m_size)
+{
+    if (m_size)
+        std::memcpy(m_data.get(), copy.m_data.get(), m_size);
+}
+
+RwDataSection::RwDataSection(std::size_t const size)
+    : m_data(allocateSectionData(size))
+    , m_size(size)
+{}
 
 RwDataSection::RwDataSection(Executable::DataSection && dataSection)
-    : Executable::DataSection(std::move(dataSection))
+    : m_data(std::move(dataSection.data))
+    , m_size(m_data ? dataSection.sizeInBytes : 0u)
 {}
 
+RwDataSection::RwDataSection(RwDataSection const & copy,
+                             std::shared_ptr<void> data)
+    : MemorySlot()
+    , m_data(copy.m_size ? std::move(data) : nullptr)
+    , m_size(copy.m_size)
+{
+    if (m_size) {
+        assert(m_data);
+        std::memcpy(m_data.get(), copy.m_data.get(), m_size);
+    }
+}
+
 RwDataSection::~RwDataSection() noexcept = default;
 
 RwDataSection & RwDataSection::operator=(RwDataSection &&) noexcept = default;
 
-RwDataSection & RwDataSection::operator=(RwDataSection const &) = default;
+RwDataSection & RwDataSection::operator=(RwDataSection const & copy) {
+    RwDataSection newSection(copy);
+    return *this = std::move(newSection);
+}
+
+void * RwDataSection::data() const noexcept { return m_data.get(); }
 
-void * RwDataSection::data() const noexcept
-{ return static_cast<Executable::DataSection const *>(this)->data.get(); }
+std::size_t RwDataSection::size() const noexcept { return m_size; }
 
-std::size_t RwDataSection::size() const noexcept { return this->sizeInBytes; }
+std::shared_ptr<MemorySlot> RwDataSection::clone() const
+{ return std::make_shared<RwDataSection>(*this); }
 
 
 
@@ -85,8 +143,14 @@ RoDataSection::RoDataSection(RoDataSection &&) noexcept = default;
 
 RoDataSection::RoDataSection(RoDataSection const &) = default;
 
+RoDataSection::RoDataSection(std::size_t const size)
+    : m_data(allocateSectionData(size))
+    , m_size(size)
+{}
+
 RoDataSection::RoDataSection(Executable::DataSection && dataSection)
-    : Executable::DataSection(std::move(dataSection))
+    : m_data(std::move(dataSection.data))
+    , m_size(m_data ? dataSection.sizeInBytes : 0u)
 {}
 
 RoDataSection::~RoDataSection() noexcept = default;
@@ -95,12 +159,60 @@ RoDataSection & RoDataSection::operator=(RoDataSection &&) noexcept = default;
 
 RoDataSection & RoDataSection::operator=(RoDataSection const &) = default;
 
-void * RoDataSection::data() const noexcept
-{ return static_cast<Executable::DataSection const *>(this)->data.get(); }
+void * RoDataSection::data() const noexcept { return m_data.get(); }
+
+std::size_t RoDataSection::size() const noexcept { return m_size; }
 
-std::size_t RoDataSection::size() const noexcept { return this->sizeInBytes; }
+std::shared_ptr<MemorySlot> RoDataSection::clone() const
+{ return std::make_shared<RoDataSection>(*this); }
 
 bool RoDataSection::isWritable() const noexcept { return false; }
 
+
+
+DataSectionBatch::DataSectionBatch(RwDataSection const & rwDataSection,
+                                   std::size_t const bssSize,
+                                   std::size_t const numProcesses)
+    : m_rwDataSection(rwDataSection)
+    , m_bssSize(bssSize)
+    , m_rwStride(cacheLineStride(rwDataSection.size()))
+    , m_bssStride(cacheLineStride(bssSize))
+    , m_rwAllocator(std::make_shared<BatchArena>(numProcesses))
+    , m_bssAllocator(std::make_shared<BatchArena>(numProcesses))
+{
+    assert(numProcesses > 0u);
+    static constexpr auto const maxSize =
+            std::numeric_limits<std::size_t>::max();
+    auto const stride = m_rwStride + m_bssStride;
+    if ((m_rwStride < rwDataSection.size())
+        || (m_bssStride < bssSize)
+        || (stride < m_rwStride)
+        || (stride > (maxSize - cacheLineSize) / numProcesses))
+        throw std::bad_alloc();
+    m_contents = allocateMemory(stride * numProcesses + cacheLineSize);
+    auto const address = reinterpret_cast<std::uintptr_t>(m_contents.get());
+    m_nextRw = static_cast<char *>(m_contents.get())
+               + (cacheLineSize - address % cacheLineSize) % cacheLineSize;
+    m_nextBss = m_nextRw + m_rwStride;
+}
+
+std::shared_ptr<RwDataSection> DataSectionBatch::newRwDataSection() {
+    auto r(std::allocate_shared<RwDataSection>(
+               m_rwAllocator,
+               m_rwDataSection,
+               std::shared_ptr<void>(m_contents, m_nextRw)));
+    m_nextRw += m_rwStride + m_bssStride;
+    return r;
+}
+
+std::shared_ptr<BssDataSection> DataSectionBatch::newBssDataSection() {
+    auto r(std::allocate_shared<BssDataSection>(
+               m_bssAllocator,
+               std::shared_ptr<void>(m_contents, m_nextBss),
+               m_bssSize));
+    m_nextBss += m_rwStride + m_bssStride;
+    return r;
+}
+
 } // namespace Detail {
 } // namespace sharemind {
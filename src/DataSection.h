@@ -28,8 +28,8 @@
 
 #include <cstddef>
 #include <memory>
-#include <sharemind/GlobalDeleter.h>
 #include <sharemind/libexecutable/Executable.h>
+#include "BatchAllocator.h"
 
 
 namespace sharemind {
@@ -46,6 +46,12 @@ public: /* Methods: */
 
     BssDataSection(std::size_t const size);
 
+    /**
+      \brief Constructs a zeroed section of the given size in the given
+             memory, which the section keeps alive.
+    */
+    BssDataSection(std::shared_ptr<void> data, std::size_t const size);
+
     ~BssDataSection() noexcept override;
 
     BssDataSection & operator=(BssDataSection &&) noexcept;
@@ -53,17 +59,17 @@ public: /* Methods: */
 
     void * data() const noexcept final override;
     std::size_t size() const noexcept final override;
+    std::shared_ptr<MemorySlot> clone() const final override;
 
 private: /* Fields: */
 
-    std::unique_ptr<void, GlobalDeleter> m_data;
+    std::shared_ptr<void> m_data;
     std::size_t m_size;
 
 };
 
 class __attribute__((visibility("internal"))) RwDataSection
-    : private Executable::DataSection
-    , public MemorySlot
+    : public MemorySlot
 {
 
 public: /* Methods: */
@@ -71,8 +77,16 @@ public: /* Methods: */
     RwDataSection(RwDataSection &&) noexcept;
     RwDataSection(RwDataSection const &);
 
+    /** \brief Constructs a section of the given size with undefined contents.*/
+    RwDataSection(std::size_t const size);
     RwDataSection(Executable::DataSection && dataSection);
 
+    /**
+      \brief Constructs a copy of the given section in the given memory, which
+             the section keeps alive.
+    */
+    RwDataSection(RwDataSection const & copy, std::shared_ptr<void> data);
+
     ~RwDataSection() noexcept override;
 
     RwDataSection & operator=(RwDataSection &&) noexcept;
@@ -80,12 +94,17 @@ public: /* Methods: */
 
     void * data() const noexcept final override;
     std::size_t size() const noexcept final override;
+    std::shared_ptr<MemorySlot> clone() const final override;
+
+private: /* Fields: */
+
+    std::shared_ptr<void> m_data;
+    std::size_t m_size;
 
 };
 
 class __attribute__((visibility("internal"))) RoDataSection
-    : private Executable::DataSection
-    , public MemorySlot
+    : public MemorySlot
 {
 
 public: /* Methods: */
@@ -93,6 +112,8 @@ public: /* Methods: */
     RoDataSection(RoDataSection &&) noexcept;
     RoDataSection(RoDataSection const &);
 
+    /** \brief Constructs a section of the given size with undefined contents.*/
+    RoDataSection(std::size_t const size);
     RoDataSection(Executable::DataSection && dataSection);
 
     ~RoDataSection() noexcept override;
@@ -103,6 +124,55 @@ public: /* Methods: */
     void * data() const noexcept final override;
     std::size_t size() const noexcept final override;
     bool isWritable() const noexcept final override;
+    std::shared_ptr<MemorySlot> clone() const final override;
+
+private: /* Fields: */
+
+    std::shared_ptr<void> m_data;
+    std::size_t m_size;
+
+};
+
+/**
+  \brief Allocates the writable data sections of a fixed number of processes
+         from contiguous chunks of memory.
+  \details Both the section objects and their contents are placed in chunks
+           shared by the whole batch, with the contents of every process
+           starting at a cache line boundary. The chunks are released when the
+           last of the sections is destroyed.
+*/
+class __attribute__((visibility("internal"))) DataSectionBatch {
+
+public: /* Methods: */
+
+    DataSectionBatch(RwDataSection const & rwDataSection,
+                     std::size_t const bssSize,
+                     std::size_t const numProcesses);
+
+    DataSectionBatch(DataSectionBatch &&) = delete;
+    DataSectionBatch(DataSectionBatch const &) = delete;
+
+    DataSectionBatch & operator=(DataSectionBatch &&) = delete;
+    DataSectionBatch & operator=(DataSectionBatch const &) = delete;
+
+    /**
+      \brief Constructs the data sections of the next process of the batch.
+      \pre Called less than numProcesses times.
+    */
+    std::shared_ptr<RwDataSection> newRwDataSection();
+    std::shared_ptr<BssDataSection> newBssDataSection();
+
+private: /* Fields: */
+
+    RwDataSection const & m_rwDataSection;
+    std::size_t const m_bssSize;
+    std::size_t const m_rwStride;
+    std::size_t const m_bssStride;
+    std::shared_ptr<void> m_contents;
+    char * m_nextRw;
+    char * m_nextBss;
+    BatchAllocator<RwDataSection> const m_rwAllocator;
+    BatchAllocator<BssDataSection> const m_bssAllocator;
 
 };
 
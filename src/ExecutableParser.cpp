@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#include "ExecutableParser.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <sharemind/likely.h>
+#include <utility>
+#include "Program.h"
+
+
+namespace sharemind {
+namespace Detail {
+
+namespace {
+
+/* The layout of the executable file format version 0x0, as in LibExecutable:*/
+
+constexpr std::size_t const headerTypeSize = 32u;
+
+struct FileHeader {
+    char magic[headerTypeSize];
+    std::uint64_t byteOrderVerification;
+    std::uint16_t fileFormatVersion;
+    std::uint8_t zeroPadding[6];
+};
+static_assert(sizeof(FileHeader) == 48u, "");
+
+struct FileHeader0x0 {
+    std::uint8_t numberOfLinkingUnitsMinusOne;
+    std::uint8_t activeLinkingUnit;
+    std::uint8_t zeroPadding[6];
+};
+static_assert(sizeof(FileHeader0x0) == 8u, "");
+
+struct LinkingUnitHeader0x0 {
+    char type[headerTypeSize];
+    std::uint8_t numberOfSectionsMinusOne;
+    std::uint8_t zeroPadding[7];
+};
+static_assert(sizeof(LinkingUnitHeader0x0) == 40u, "");
+
+struct SectionHeader0x0 {
+    char type[headerTypeSize];
+    std::uint32_t length;
+    std::uint8_t zeroPadding[4];
+};
+static_assert(sizeof(SectionHeader0x0) == 40u, "");
+
+enum class SectionType {
+    Text,
+    RoData,
+    Data,
+    Bss,
+    Bind,
+    PdBind,
+    Debug,
+    Count
+};
+
+char const fileMagic[headerTypeSize] = "Sharemind Executable";
+constexpr std::uint64_t const byteOrderVerification = 0x0123456789abcdefu;
+char const linkingUnitType[headerTypeSize] = "Linking Unit";
+char const sectionTypes[static_cast<std::size_t>(SectionType::Count)]
+                       [headerTypeSize] =
+        { "TEXT", "RODATA", "DATA", "BSS", "BIND", "PDBIND", "DEBUG" };
+
+template <std::size_t N>
+bool isZeroPadding(std::uint8_t const (& padding)[N]) noexcept {
+    return std::all_of(padding,
+                       padding + N,
+                       [](std::uint8_t const v) noexcept { return !v; });
+}
+
+bool typeEquals(char const (& type)[headerTypeSize],
+                char const (& expected)[headerTypeSize]) noexcept
+{ return std::memcmp(type, expected, headerTypeSize) == 0; }
+
+std::size_t paddingForSize(std::size_t const size) noexcept
+{ return (8u - (size % 8u)) % 8u; }
+
+template <typename T>
+T readHeader(ExecutableReader & reader) {
+    T header;
+    reader.read(&header, sizeof(header));
+    return header;
+}
+
+void readBindings(ExecutableReader & reader,
+                  std::size_t const length,
+                  std::vector<std::string> & bindings)
+{
+    if (!length)
+        throw Program::InvalidInputFileException();
+    std::unique_ptr<char[]> const buffer(new char[length]);
+    reader.read(buffer.get(), length);
+    if (buffer[length - 1u] != '\0')
+        throw Program::InvalidInputFileException();
+    for (char const * pos = buffer.get(); pos != buffer.get() + length;) {
+        auto const nameLength = std::strlen(pos);
+        if (!nameLength)
+            throw Program::InvalidInputFileException();
+        bindings.emplace_back(pos, nameLength);
+        pos += nameLength + 1u;
+    }
+}
+
+void parseSection(ExecutableReader & reader,
+                  ParsedLinkingUnit & linkingUnit,
+                  SectionType const type,
+                  std::size_t const length)
+{
+    /*
+      Do not allocate storage for data which is not there. The length of the
+      text section is in code blocks, that of other sections in bytes:
+    */
+    if ((type == SectionType::Text)
+        ? (length > reader.sizeBound() / sizeof(SharemindCodeBlock))
+        : ((type != SectionType::Bss) && (length > reader.sizeBound())))
+        throw Program::InvalidInputFileException();
+
+    switch (type) {
+    case SectionType::Text:
+        linkingUnit.hasTextSection = true;
+        linkingUnit.textSection.resize(length);
+        if (length)
+            reader.read(linkingUnit.textSection.data(),
+                        length * sizeof(SharemindCodeBlock));
+        return; // Code blocks need no padding
+    case SectionType::RoData:
+        linkingUnit.roDataSection = RoDataSection(length);
+        if (length)
+            reader.read(linkingUnit.roDataSection.data(), length);
+        break;
+    case SectionType::Data:
+        linkingUnit.rwDataSection = RwDataSection(length);
+        if (length)
+            reader.read(linkingUnit.rwDataSection.data(), length);
+        break;
+    case SectionType::Bss:
+        linkingUnit.bssSectionSize = length;
+        return; // No data nor padding
+    case SectionType::Bind:
+        readBindings(reader, length, linkingUnit.syscallBindings);
+        break;
+    case SectionType::PdBind:
+    case SectionType::Debug:
+        /* Not used by the VM: */
+        reader.skip(length);
+        break;
+    case SectionType::Count:
+        assert(false);
+        break;
+    }
+
+    /* Skip and validate the padding to the 8-byte boundary: */
+    if (auto const padding = paddingForSize(length)) {
+        std::uint8_t paddingData[8u] = {};
+        reader.read(paddingData, padding);
+        if (!isZeroPadding(paddingData))
+            throw Program::InvalidSectionHeader0x0Exception();
+    }
+}
+
+ParsedLinkingUnit parseLinkingUnit(ExecutableReader & reader) {
+    auto const unitHeader(readHeader<LinkingUnitHeader0x0>(reader));
+    if (!typeEquals(unitHeader.type, linkingUnitType)
+        || !isZeroPadding(unitHeader.zeroPadding))
+        throw Program::InvalidLinkingUnitHeader0x0Exception();
+
+    ParsedLinkingUnit linkingUnit;
+    bool seenSections[static_cast<std::size_t>(SectionType::Count)] = {};
+    std::size_t const numSections =
+            unitHeader.numberOfSectionsMinusOne + 1u;
+    for (std::size_t i = 0u; i < numSections; ++i) {
+        auto const sectionHeader(readHeader<SectionHeader0x0>(reader));
+        if (!isZeroPadding(sectionHeader.zeroPadding))
+            throw Program::InvalidSectionHeader0x0Exception();
+
+        auto const typeIt =
+                std::find_if(
+                    std::begin(sectionTypes),
+                    std::end(sectionTypes),
+                    [&sectionHeader](char const (& type)[headerTypeSize])
+                    { return typeEquals(sectionHeader.type, type); });
+        if (typeIt == std::end(sectionTypes))
+            throw Program::InvalidSectionHeader0x0Exception();
+        auto const typeIndex =
+                static_cast<std::size_t>(typeIt - std::begin(sectionTypes));
+
+        /* Each section type may only appear once per linking unit: */
+        if (seenSections[typeIndex])
+            throw Program::InvalidSectionHeader0x0Exception();
+        seenSections[typeIndex] = true;
+
+        parseSection(reader,
+                     linkingUnit,
+                     static_cast<SectionType>(typeIndex),
+                     sectionHeader.length);
+    }
+    return linkingUnit;
+}
+
+} // anonymous namespace
+
+
+ParsedLinkingUnit::ParsedLinkingUnit() = default;
+
+ParsedLinkingUnit::ParsedLinkingUnit(ParsedLinkingUnit &&) noexcept = default;
+
+ParsedLinkingUnit::ParsedLinkingUnit(Executable::LinkingUnit && linkingUnit)
+    : hasTextSection(static_cast<bool>(linkingUnit.textSection))
+    , textSection(linkingUnit.textSection
+                  ? std::move(linkingUnit.textSection->instructions)
+                  : std::vector<SharemindCodeBlock>())
+    , roDataSection(linkingUnit.roDataSection
+                    ? std::move(*linkingUnit.roDataSection)
+                    : Executable::DataSection())
+    , rwDataSection(linkingUnit.rwDataSection
+                    ? std::move(*linkingUnit.rwDataSection)
+                    : Executable::DataSection())
+    , bssSectionSize(linkingUnit.bssSection
+                     ? linkingUnit.bssSection->sizeInBytes
+                     : 0u)
+    , syscallBindings(linkingUnit.syscallBindingsSection
+                      ? std::move(
+                            linkingUnit.syscallBindingsSection->syscallBindings)
+                      : std::vector<std::string>())
+{}
+
+ParsedLinkingUnit::~ParsedLinkingUnit() noexcept = default;
+
+ParsedLinkingUnit & ParsedLinkingUnit::operator=(ParsedLinkingUnit &&) noexcept
+        = default;
+
+
+ParsedExecutable::ParsedExecutable() = default;
+
+ParsedExecutable::ParsedExecutable(ParsedExecutable &&) noexcept = default;
+
+ParsedExecutable::ParsedExecutable(Executable && executable)
+    : activeLinkingUnitIndex(executable.activeLinkingUnitIndex)
+{
+    linkingUnits.reserve(executable.linkingUnits.size());
+    for (auto & linkingUnit : executable.linkingUnits)
+        linkingUnits.emplace_back(std::move(linkingUnit));
+}
+
+ParsedExecutable::~ParsedExecutable() noexcept = default;
+
+ParsedExecutable & ParsedExecutable::operator=(ParsedExecutable &&) noexcept
+        = default;
+
+
+ExecutableReader::~ExecutableReader() noexcept = default;
+
+
+MemoryExecutableReader::MemoryExecutableReader(void const * data,
+                                               std::size_t size) noexcept
+    : m_pos(static_cast<char const *>(data))
+    , m_left(size)
+{}
+
+void MemoryExecutableReader::read(void * buffer, std::size_t size) {
+    if (unlikely(size > m_left))
+        throw Program::InvalidInputFileException();
+    std::memcpy(buffer, m_pos, size);
+    m_pos += size;
+    m_left -= size;
+}
+
+void MemoryExecutableReader::skip(std::size_t size) {
+    if (unlikely(size > m_left))
+        throw Program::InvalidInputFileException();
+    m_pos += size;
+    m_left -= size;
+}
+
+bool MemoryExecutableReader::atEnd() noexcept { return !m_left; }
+
+std::size_t MemoryExecutableReader::sizeBound() const noexcept
+{ return m_left; }
+
+
+ParsedExecutable parseExecutable(ExecutableReader & reader) {
+    {
+        auto const header(readHeader<FileHeader>(reader));
+        if (!typeEquals(header.magic, fileMagic)
+            || (header.byteOrderVerification != byteOrderVerification)
+            || !isZeroPadding(header.zeroPadding))
+            throw Program::InvalidFileHeaderException();
+        if (header.fileFormatVersion != 0x0u)
+            throw Program::VersionMismatchException();
+    }
+
+    auto const header(readHeader<FileHeader0x0>(reader));
+    if ((header.activeLinkingUnit > header.numberOfLinkingUnitsMinusOne)
+        || !isZeroPadding(header.zeroPadding))
+        throw Program::InvalidFileHeader0x0Exception();
+
+    ParsedExecutable r;
+    r.activeLinkingUnitIndex = header.activeLinkingUnit;
+    std::size_t const numLinkingUnits =
+            header.numberOfLinkingUnitsMinusOne + 1u;
+    r.linkingUnits.reserve(numLinkingUnits);
+    for (std::size_t i = 0u; i < numLinkingUnits; ++i)
+        r.linkingUnits.emplace_back(parseLinkingUnit(reader));
+
+    if (!reader.atEnd())
+        throw Program::InvalidInputFileException();
+    return r;
+}
+
+} // namespace Detail {
+} // namespace sharemind {
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_LIBVM_EXECUTABLEPARSER_H
+#define SHAREMIND_LIBVM_EXECUTABLEPARSER_H
+
+#ifndef SHAREMIND_INTERNAL_
+#error including an internal header!
+#endif
+
+#include <cstddef>
+#include <sharemind/codeblock.h>
+#include <sharemind/libexecutable/Executable.h>
+#include <string>
+#include <vector>
+#include "DataSection.h"
+
+
+namespace sharemind {
+namespace Detail {
+
+struct __attribute__((visibility("internal"))) ParsedLinkingUnit {
+
+/* Methods: */
+
+    ParsedLinkingUnit();
+    ParsedLinkingUnit(ParsedLinkingUnit &&) noexcept;
+    ParsedLinkingUnit(ParsedLinkingUnit const &) = delete;
+
+    ParsedLinkingUnit(Executable::LinkingUnit && linkingUnit);
+
+    ~ParsedLinkingUnit() noexcept;
+
+    ParsedLinkingUnit & operator=(ParsedLinkingUnit &&) noexcept;
+    ParsedLinkingUnit & operator=(ParsedLinkingUnit const &) = delete;
+
+/* Fields: */
+
+    bool hasTextSection = false;
+    std::vector<SharemindCodeBlock> textSection;
+    RoDataSection roDataSection{0u};
+    RwDataSection rwDataSection{0u};
+    std::size_t bssSectionSize = 0u;
+    std::vector<std::string> syscallBindings;
+
+};
+
+struct __attribute__((visibility("internal"))) ParsedExecutable {
+
+/* Methods: */
+
+    ParsedExecutable();
+    ParsedExecutable(ParsedExecutable &&) noexcept;
+    ParsedExecutable(ParsedExecutable const &) = delete;
+
+    ParsedExecutable(Executable && executable);
+
+    ~ParsedExecutable() noexcept;
+
+    ParsedExecutable & operator=(ParsedExecutable &&) noexcept;
+    ParsedExecutable & operator=(ParsedExecutable const &) = delete;
+
+/* Fields: */
+
+    std::vector<ParsedLinkingUnit> linkingUnits;
+    std::size_t activeLinkingUnitIndex = 0u;
+
+};
+
+/**
+  \brief Interface for sequential sources of executable file data.
+  \details Implementations copy (or otherwise produce) the data straight into
+           the destination buffers, which are the final storage of the parsed
+           sections.
+*/
+class __attribute__((visibility("internal"))) ExecutableReader {
+
+public: /* Methods: */
+
+    virtual ~ExecutableReader() noexcept;
+
+    /**
+      \brief Reads exactly the given number of bytes to the given buffer.
+      \throws Program::InvalidInputFileException if not enough data is left.
+    */
+    virtual void read(void * buffer, std::size_t size) = 0;
+
+    /**
+      \brief Skips exactly the given number of bytes.
+      \throws Program::InvalidInputFileException if not enough data is left.
+    */
+    virtual void skip(std::size_t size) = 0;
+
+    /** \returns whether all input has been consumed. */
+    virtual bool atEnd() = 0;
+
+    /**
+      \returns an upper bound of the number of bytes left to read.
+      \details Used to reject section lengths which can not be backed by data
+               before allocating storage for them.
+    */
+    virtual std::size_t sizeBound() const noexcept = 0;
+
+};
+
+class __attribute__((visibility("internal"))) MemoryExecutableReader final
+    : public ExecutableReader
+{
+
+public: /* Methods: */
+
+    MemoryExecutableReader(void const * data, std::size_t size) noexcept;
+
+    void read(void * buffer, std::size_t size) final override;
+    void skip(std::size_t size) final override;
+    bool atEnd() noexcept final override;
+    std::size_t sizeBound() const noexcept final override;
+
+private: /* Fields: */
+
+    char const * m_pos;
+    std::size_t m_left;
+
+};
+
+/**
+  \brief Parses and validates an executable of file format version 0x0 without
+         any intermediate copies of the section data.
+  \throws Program::PrepareException on invalid input.
+*/
+ParsedExecutable parseExecutable(ExecutableReader & reader)
+        __attribute__((visibility("internal")));
+
+} /* namespace Detail { */
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_LIBVM_EXECUTABLEPARSER_H */
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#include "GzipExecutableReader.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <sharemind/likely.h>
+#include "Program.h"
+
+
+namespace sharemind {
+namespace Detail {
+
+namespace {
+
+constexpr std::size_t const maxZlibChunk = std::numeric_limits<uInt>::max();
+
+/* Deflate expands at most 258 bytes per 2 bits of input, i.e. ~1032:1: */
+constexpr std::size_t const maxDeflateRatio = 1032u;
+
+/* Output which inflate might have pending for already consumed input: */
+constexpr std::size_t const maxPendingInflated = 64u * 1024u;
+
+} // anonymous namespace
+
+GzipExecutableReader::GzipExecutableReader(void const * data,
+                                           std::size_t size,
+                                           std::size_t maxInflatedSize)
+    : m_input(static_cast<unsigned char const *>(data))
+    , m_inputLeft(size)
+    , m_inflatedLeft(maxInflatedSize)
+{
+    std::memset(&m_stream, 0, sizeof(m_stream));
+    /* Accept only the gzip format, with the maximum window size: */
+    switch (::inflateInit2(&m_stream, 16 + MAX_WBITS)) {
+    case Z_OK:
+        break;
+    case Z_MEM_ERROR:
+        throw std::bad_alloc();
+    default:
+        throw Program::InvalidInputFileException();
+    }
+}
+
+GzipExecutableReader::~GzipExecutableReader() noexcept
+{ ::inflateEnd(&m_stream); }
+
+void GzipExecutableReader::read(void * buffer, std::size_t size) {
+    auto * out = static_cast<unsigned char *>(buffer);
+    while (size) {
+        auto const produced = inflateTo(out, size);
+        if (unlikely(!produced))
+            throw Program::InvalidInputFileException();
+        out += produced;
+        size -= produced;
+    }
+}
+
+void GzipExecutableReader::skip(std::size_t size) {
+    unsigned char scratch[4096u];
+    while (size) {
+        auto const toRead = std::min(size, sizeof(scratch));
+        read(scratch, toRead);
+        size -= toRead;
+    }
+}
+
+bool GzipExecutableReader::atEnd() {
+    if (!m_streamEnd) {
+        unsigned char scratch;
+        if (inflateTo(&scratch, 1u))
+            return false;
+        if (!m_streamEnd)
+            throw Program::InvalidInputFileException();
+    }
+    /* Trailing garbage after the gzip stream is not allowed: */
+    return !m_stream.avail_in && !m_inputLeft;
+}
+
+std::size_t GzipExecutableReader::sizeBound() const noexcept {
+    if (m_streamEnd)
+        return 0u;
+    auto const inputLeft = m_stream.avail_in + m_inputLeft;
+    auto const maxExpansion =
+            (inputLeft > (std::numeric_limits<std::size_t>::max()
+                          - maxPendingInflated) / maxDeflateRatio)
+            ? std::numeric_limits<std::size_t>::max()
+            : inputLeft * maxDeflateRatio + maxPendingInflated;
+    return std::min(maxExpansion, m_inflatedLeft);
+}
+
+bool GzipExecutableReader::hasMagic(void const * data, std::size_t size)
+        noexcept
+{
+    auto const * const d = static_cast<unsigned char const *>(data);
+    return (size >= 2u) && (d[0u] == 0x1fu) && (d[1u] == 0x8bu);
+}
+
+std::size_t GzipExecutableReader::inflateTo(unsigned char * buffer,
+                                            std::size_t size)
+{
+    assert(size > 0u);
+    std::size_t totalProduced = 0u;
+    while (size && !m_streamEnd) {
+        if (!m_stream.avail_in && m_inputLeft) {
+            auto const chunk = std::min(m_inputLeft, maxZlibChunk);
+            m_stream.next_in = const_cast<Bytef *>(m_input);
+            m_stream.avail_in = static_cast<uInt>(chunk);
+            m_input += chunk;
+            m_inputLeft -= chunk;
+        }
+
+        /* Detect inflating beyond the limit via one byte of extra room: */
+        auto chunk = std::min(size, maxZlibChunk);
+        if (chunk > m_inflatedLeft)
+            chunk = m_inflatedLeft + 1u;
+        m_stream.next_out = buffer;
+        m_stream.avail_out = static_cast<uInt>(chunk);
+        auto const r = ::inflate(&m_stream, Z_NO_FLUSH);
+        auto const produced = chunk - m_stream.avail_out;
+        if (produced > m_inflatedLeft)
+            throw Program::ImplementationLimitsReachedException();
+        m_inflatedLeft -= produced;
+        buffer += produced;
+        size -= produced;
+        totalProduced += produced;
+
+        switch (r) {
+        case Z_OK:
+            break;
+        case Z_STREAM_END:
+            m_streamEnd = true;
+            break;
+        case Z_MEM_ERROR:
+            throw std::bad_alloc();
+        case Z_BUF_ERROR:
+            /* No progress possible, i.e. the input is truncated: */
+            if (!m_stream.avail_in && !m_inputLeft)
+                return totalProduced;
+            break;
+        default:
+            throw Program::InvalidInputFileException();
+        }
+    }
+    return totalProduced;
+}
+
+} // namespace Detail {
+} // namespace sharemind {
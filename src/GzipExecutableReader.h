@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_LIBVM_GZIPEXECUTABLEREADER_H
+#define SHAREMIND_LIBVM_GZIPEXECUTABLEREADER_H
+
+#ifndef SHAREMIND_INTERNAL_
+#error including an internal header!
+#endif
+
+#include <cstddef>
+#include <zlib.h>
+#include "ExecutableParser.h"
+
+
+namespace sharemind {
+namespace Detail {
+
+/**
+  \brief Reads executables from gzip-compressed memory areas.
+  \details The data is inflated on demand straight into the buffers passed to
+           read(), hence the whole decompressed executable is never held in
+           memory in addition to the parsed sections. The size bound is
+           derived from the maximum compression ratio of deflate, so that
+           section buffers can only be as large as the compressed input can
+           actually expand to, and from a limit on the total inflated size.
+*/
+class __attribute__((visibility("internal"))) GzipExecutableReader final
+    : public ExecutableReader
+{
+
+public: /* Methods: */
+
+    /**
+      \param[in] maxInflatedSize The maximum total size of the inflated data.
+    */
+    GzipExecutableReader(void const * data,
+                         std::size_t size,
+                         std::size_t maxInflatedSize);
+    ~GzipExecutableReader() noexcept override;
+
+    void read(void * buffer, std::size_t size) final override;
+    void skip(std::size_t size) final override;
+    bool atEnd() final override;
+    std::size_t sizeBound() const noexcept final override;
+
+    /** \returns whether the given data starts with the gzip magic number. */
+    static bool hasMagic(void const * data, std::size_t size) noexcept;
+
+private: /* Methods: */
+
+    std::size_t inflateTo(unsigned char * buffer, std::size_t size);
+
+private: /* Fields: */
+
+    ::z_stream m_stream;
+    unsigned char const * m_input;
+    std::size_t m_inputLeft;
+    std::size_t m_inflatedLeft;
+    bool m_streamEnd = false;
+
+};
+
+} /* namespace Detail { */
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_LIBVM_GZIPEXECUTABLEREADER_H */
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#include "InputMemory.h"
+
+#include <utility>
+
+
+namespace sharemind {
+namespace Detail {
+
+InputMemory::InputMemory(std::shared_ptr<void const> data,
+                         std::size_t const size) noexcept
+    : m_data(std::move(data))
+    , m_size(size)
+{}
+
+InputMemory::~InputMemory() noexcept {}
+
+void * InputMemory::data() const noexcept
+{ return const_cast<void *>(m_data.get()); }
+
+std::size_t InputMemory::size() const noexcept { return m_size; }
+
+bool InputMemory::isWritable() const noexcept { return false; }
+
+std::shared_ptr<MemorySlot> InputMemory::clone() const
+{ return std::make_shared<InputMemory>(*this); }
+
+} // namespace Detail {
+} // namespace sharemind {
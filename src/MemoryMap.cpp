@@ -31,6 +31,8 @@ namespace sharemind {
 namespace Detail {
 
 MemoryMap::ValueType const & MemoryMap::get(KeyType const ptr) const noexcept {
+    if (ptr < numReservedPointers)
+        return m_reserved[ptr];
     auto const it(m_inner.find(ptr));
     return (it != m_inner.end()) ? it->second : m_notFound;
 }
@@ -38,17 +40,15 @@ MemoryMap::ValueType const & MemoryMap::get(KeyType const ptr) const noexcept {
 void MemoryMap::insertSlot(KeyType ptr, ValueType slot) {
     assert(ptr);
     assert(ptr < numReservedPointers);
-    assert(m_inner.find(ptr) == m_inner.end());
-    if (!slot)
-        return;
-    m_inner.emplace(std::move(ptr), std::move(slot));
+    assert(!m_reserved[ptr]);
+    m_reserved[ptr] = std::move(slot);
 }
 
 MemoryMap::KeyType MemoryMap::allocate(std::size_t const size) {
     /* All reserved pointers must have been allocated beforehand: */
     #ifndef NDEBUG
     for (KeyType i = 1u; i < numReservedPointers; ++i)
-        assert(m_inner.find(i) != m_inner.end());
+        assert(m_reserved[i]);
     #endif
 
     auto const ptr(findUnusedPtr());
@@ -56,6 +56,30 @@ MemoryMap::KeyType MemoryMap::allocate(std::size_t const size) {
     return ptr;
 }
 
+MemoryMap::KeyType MemoryMap::insert(ValueType slot) {
+    assert(slot);
+    auto const ptr(findUnusedPtr());
+    m_inner.emplace(ptr, std::move(slot));
+    return ptr;
+}
+
+bool MemoryMap::insertAt(KeyType const ptr, ValueType slot) {
+    assert(ptr >= numReservedPointers);
+    assert(slot);
+    return m_inner.emplace(ptr, std::move(slot)).second;
+}
+
+MemoryMap::ValueType MemoryMap::replace(KeyType const ptr, ValueType slot)
+        noexcept
+{
+    assert(ptr >= numReservedPointers);
+    assert(slot);
+    auto const it(m_inner.find(ptr));
+    assert(it != m_inner.end());
+    std::swap(it->second, slot);
+    return slot;
+}
+
 std::pair<MemoryMap::ErrorCode, std::size_t> MemoryMap::free(KeyType const ptr)
 {
     using R = std::pair<ErrorCode, std::size_t>;
@@ -70,13 +94,44 @@ std::pair<MemoryMap::ErrorCode, std::size_t> MemoryMap::free(KeyType const ptr)
 }
 
 std::size_t MemoryMap::slotSize(KeyType const ptr) const noexcept {
-    auto const it(m_inner.find(ptr));
-    return (it == m_inner.end()) ? 0u : it->second->size();
+    auto const & slot = get(ptr);
+    return slot ? slot->size() : 0u;
 }
 
 void * MemoryMap::slotPtr(KeyType const ptr) const noexcept {
-    auto const it(m_inner.find(ptr));
-    return (it == m_inner.end()) ? nullptr : it->second->data();
+    auto const & slot = get(ptr);
+    return slot ? slot->data() : nullptr;
+}
+
+std::vector<MemoryMap::ClonedSlot> MemoryMap::cloneWritableSlots() {
+    std::vector<ClonedSlot> r;
+    r.reserve(numReservedPointers + m_inner.size());
+    for (KeyType i = 1u; i < numReservedPointers; ++i)
+        if (m_reserved[i] && m_reserved[i]->isWritable())
+            r.emplace_back(
+                    ClonedSlot{i, m_reserved[i], m_reserved[i]->clone()});
+    for (auto const & vp : m_inner) {
+        assert(vp.second);
+        if (vp.second->isWritable())
+            r.emplace_back(ClonedSlot{vp.first, vp.second, vp.second->clone()});
+    }
+
+    /* Replace the slots only after all copies have succeeded: */
+    for (auto const & clonedSlot : r) {
+        if (clonedSlot.ptr < numReservedPointers) {
+            m_reserved[clonedSlot.ptr] = clonedSlot.copy;
+            continue;
+        }
+        auto const it(m_inner.find(clonedSlot.ptr));
+        assert(it != m_inner.end());
+        it->second = clonedSlot.copy;
+    }
+    return r;
+}
+
+void MemoryMap::freeAllocated() noexcept {
+    m_inner.clear();
+    m_nextTryPtr = numReservedPointers;
 }
 
 MemoryMap::KeyType MemoryMap::findUnusedPtr() const noexcept {
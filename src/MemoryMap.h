@@ -28,6 +28,7 @@
 #include <cstdint>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 
 namespace sharemind {
@@ -44,9 +45,16 @@ public: /* Types: */
 
     enum ErrorCode { Ok, MemorySlotInUse, InvalidMemoryHandle };
 
-private: /* Constants: */
+    struct ClonedSlot {
+        KeyType ptr;
+        ValueType original;
+        ValueType copy;
+    };
+
+public: /* Constants: */
 
     constexpr static KeyType numDataSections = 3u;
+    /** Pointer 0 is invalid and pointers 1 to 3 denote the data sections. */
     constexpr static KeyType numReservedPointers = numDataSections + 1u;
 
 public: /* Methods: */
@@ -57,11 +65,48 @@ public: /* Methods: */
 
     KeyType allocate(std::size_t const size);
 
+    /** \brief Inserts the given slot at an unused non-reserved pointer. */
+    KeyType insert(ValueType slot);
+
+    /**
+      \brief Inserts the given slot at the given non-reserved pointer.
+      \returns whether the pointer was unused.
+    */
+    bool insertAt(KeyType const ptr, ValueType slot);
+
+    /**
+      \brief Replaces the slot at the given used non-reserved pointer.
+      \returns the replaced slot.
+    */
+    ValueType replace(KeyType const ptr, ValueType slot) noexcept;
+
     std::pair<ErrorCode, std::size_t> free(KeyType const ptr);
 
     std::size_t slotSize(KeyType const ptr) const noexcept;
     void * slotPtr(KeyType const ptr) const noexcept;
 
+    /**
+      \brief Replaces all writable slots with copies of themselves, so that this
+             map no longer shares writable memory with the map it was copied
+             from. Read-only slots remain shared.
+      \returns the original and the copy of every replaced slot.
+      \note Provides the strong exception guarantee.
+    */
+    std::vector<ClonedSlot> cloneWritableSlots();
+
+    /** \brief Frees all slots except the reserved ones. */
+    void freeAllocated() noexcept;
+
+    /** \brief Calls f(ptr, slot) for every slot, in no particular order. */
+    template <typename F>
+    void forEachSlot(F && f) const {
+        for (KeyType ptr = 1u; ptr < numReservedPointers; ++ptr)
+            if (m_reserved[ptr])
+                f(ptr, m_reserved[ptr]);
+        for (auto const & vp : m_inner)
+            f(vp.first, vp.second);
+    }
+
 private: /* Methods: */
 
     KeyType findUnusedPtr() const noexcept;
@@ -69,6 +114,9 @@ private: /* Methods: */
 private: /* Fields: */
 
     ValueType const m_notFound;
+    /** The reserved slots, stored inline (index 0 is always empty): */
+    ValueType m_reserved[numReservedPointers];
+    /** The other slots: */
     std::unordered_map<KeyType, ValueType> m_inner;
     mutable KeyType m_nextTryPtr = numReservedPointers;
 
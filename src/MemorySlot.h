@@ -25,6 +25,7 @@
 #endif
 
 #include <cstddef>
+#include <memory>
 
 
 namespace sharemind {
@@ -45,6 +46,12 @@ public: /* Methods: */
     virtual std::size_t size() const noexcept = 0;
     virtual bool isWritable() const noexcept;
 
+    /**
+      \returns a copy of this memory slot, which for writable slots does not
+               share any data with the original.
+    */
+    virtual std::shared_ptr<MemorySlot> clone() const = 0;
+
 protected: /* Methods: */
 
     MemorySlot() noexcept {}
@@ -31,7 +31,12 @@ namespace sharemind {
 namespace Detail {
 
 struct __attribute__((visibility("internal"))) PreparationBlock {
-    enum LabelType { InstructionLabel, EofLabel };
+    enum LabelType {
+        InstructionLabel,
+        EofLabel,
+        /** The opcode counting trampoline, see CodeSection::countedHandler().*/
+        CountingLabel
+    };
     SharemindCodeBlock * block;
     LabelType labelType;
 };
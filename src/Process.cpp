@@ -20,21 +20,26 @@
 #include "Process.h"
 #include "Process_p.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cctype>
 #include <cinttypes>
 #include <cstdio>
 #include <cstring>
+#include <initializer_list>
+#include <iterator>
 #include <limits>
 #include <new>
 #include <sharemind/AssertReturn.h>
+#include <vector>
+#include "InputMemory.h"
+#include "Profiler_p.h"
 #include "Program.h"
 
 
 namespace sharemind {
 
 #define GUARD_(g) std::lock_guard<decltype(g)> const guard(g)
-#define GUARD GUARD_(m_mutex)
 #define RUNSTATEGUARD GUARD_(m_runStateMutex)
 #define DEFINE_BASE_EXCEPTION(base,e) \
     SHAREMIND_DEFINE_EXCEPTION_NOINLINE(base, Process::, e)
@@ -51,8 +56,56 @@ DEFINE_CONSTMSG_EXCEPTION(
         InvalidInputStateException,
         NotInTrappedStateException,
         "Process not in trapped state!");
+DEFINE_CONSTMSG_EXCEPTION(
+        InvalidInputStateException,
+        NotInInitializedOrTrappedStateException,
+        "Process not in initialized nor in trapped state!");
+DEFINE_CONSTMSG_EXCEPTION(
+        InvalidInputStateException,
+        NotInFinishedOrCrashedStateException,
+        "Process not in finished nor in crashed state!");
+DEFINE_CONSTMSG_EXCEPTION(
+        InvalidInputStateException,
+        NotInFinishedStateException,
+        "Process not in finished state!");
+DEFINE_CONSTMSG_EXCEPTION(
+        InvalidInputStateException,
+        NotInInitializedOrFinishedStateException,
+        "Process not in initialized nor in finished state!");
+DEFINE_CONSTMSG_EXCEPTION(
+        InvalidInputStateException,
+        NotInInitializedTrappedOrFinishedStateException,
+        "Process not in initialized, trapped nor finished state!");
+DEFINE_BASE_EXCEPTION(Exception, CheckpointException);
+DEFINE_CONSTMSG_EXCEPTION(CheckpointException,
+                          CheckpointIoException,
+                          "Failed to write the checkpoint!");
+DEFINE_CONSTMSG_EXCEPTION(CheckpointException,
+                          UncheckpointableStateException,
+                          "Process state cannot be checkpointed!");
+DEFINE_CONSTMSG_EXCEPTION(CheckpointException,
+                          InvalidCheckpointException,
+                          "Invalid checkpoint!");
+DEFINE_CONSTMSG_EXCEPTION(CheckpointException,
+                          CheckpointBaseMismatchException,
+                          "Checkpoint not based on the given process!");
+DEFINE_CONSTMSG_EXCEPTION(CheckpointException,
+                          CheckpointSharedSegmentMismatchException,
+                          "Shared segment of checkpoint not in program!");
+DEFINE_CONSTMSG_EXCEPTION(CheckpointException,
+                          CheckpointMemoryLimitException,
+                          "Checkpoint exceeds the memory limits!");
 DEFINE_BASE_EXCEPTION(Exception, RuntimeException);
 DEFINE_CONSTMSG_EXCEPTION(RuntimeException, TrapException, "Process trapped!");
+DEFINE_CONSTMSG_EXCEPTION(TrapException,
+                          FuelExhaustedException,
+                          "Process ran out of fuel!");
+DEFINE_CONSTMSG_EXCEPTION(RuntimeException,
+                          SyscallPendingException,
+                          "Process suspended in a system call!");
+DEFINE_CONSTMSG_EXCEPTION(RuntimeException,
+                          CancelledException,
+                          "Process was cancelled!");
 DEFINE_BASE_EXCEPTION(RuntimeException, RegularRuntimeException);
 DEFINE_CONSTMSG_EXCEPTION(RegularRuntimeException,
                           InvalidStackIndexException,
@@ -192,8 +245,120 @@ struct UserDefinedExceptionData {
     std::uint64_t errorCode = 0u;
 };
 
+/**
+  \brief Maps addresses in the memory of a process to the corresponding
+         addresses in the memory of a copy of that process.
+*/
+class AddressTranslator {
+
+private: /* Types: */
+
+    struct Range {
+        char const * oldBegin;
+        char const * oldEnd;
+        char * newBegin;
+        /** The new owner of the memory, or nullptr for stack memory. */
+        std::shared_ptr<Detail::MemorySlot const> newOwner;
+    };
+
+public: /* Methods: */
+
+    void addRange(void const * const oldData,
+                  std::size_t const size,
+                  void * const newData,
+                  std::shared_ptr<Detail::MemorySlot const> newOwner = nullptr)
+    {
+        if (!size)
+            return;
+        auto const * const oldBegin = static_cast<char const *>(oldData);
+        m_ranges.emplace_back(Range{oldBegin,
+                                    oldBegin + size,
+                                    static_cast<char *>(newData),
+                                    std::move(newOwner)});
+        m_sorted = false;
+    }
+
+    template <typename T>
+    T * translate(T * const ptr, std::size_t const size = sizeof(T)) {
+        if (auto const * const range = findRange(ptr, size))
+            return static_cast<T *>(
+                        static_cast<void *>(
+                            range->newBegin
+                            + (static_cast<char const *>(
+                                   static_cast<void const *>(ptr))
+                               - range->oldBegin)));
+        return ptr;
+    }
+
+    void translate(Vm::Reference & ref) {
+        if (auto const * const range = findRange(ref.data.get(), ref.size))
+            ref.data = std::shared_ptr<void>(
+                           range->newOwner,
+                           range->newBegin + (static_cast<char const *>(
+                                                  ref.data.get())
+                                              - range->oldBegin));
+    }
+
+    void translate(Vm::ConstReference & ref) {
+        if (auto const * const range = findRange(ref.data.get(), ref.size))
+            ref.data = std::shared_ptr<void const>(
+                           range->newOwner,
+                           range->newBegin + (static_cast<char const *>(
+                                                  ref.data.get())
+                                              - range->oldBegin));
+    }
+
+private: /* Methods: */
+
+    Range const * findRange(void const * const ptr, std::size_t const size) {
+        if (!m_sorted) {
+            std::sort(m_ranges.begin(),
+                      m_ranges.end(),
+                      [](Range const & lhs, Range const & rhs) noexcept
+                      { return lhs.oldBegin < rhs.oldBegin; });
+            m_sorted = true;
+        }
+
+        auto const * const p = static_cast<char const *>(ptr);
+        auto it(std::upper_bound(m_ranges.begin(),
+                                 m_ranges.end(),
+                                 p,
+                                 [](char const * const p, Range const & r)
+                                         noexcept
+                                 { return p < r.oldBegin; }));
+        if (it == m_ranges.begin())
+            return nullptr;
+        --it;
+        if ((p >= it->oldEnd) || (size > std::size_t(it->oldEnd - p)))
+            return nullptr;
+        return &*it;
+    }
+
+private: /* Fields: */
+
+    std::vector<Range> m_ranges;
+    bool m_sorted = true;
+
+};
+
+void throwUnlessFinished(Process::ExecutionResult const result) {
+    switch (result) {
+    case Process::ExecutionResult::Finished:
+        return;
+    case Process::ExecutionResult::Trapped:
+    case Process::ExecutionResult::Held:
+        throw Process::TrapException();
+    case Process::ExecutionResult::FuelExhausted:
+        throw Process::FuelExhaustedException();
+    case Process::ExecutionResult::Suspended:
+        throw Process::SyscallPendingException();
+    }
+}
+
 } // anonymous namespace
 
+constexpr std::uint64_t const Process::unlimitedFuel;
+
 Process::UserDefinedException::UserDefinedException()
     : m_data(std::make_shared<UserDefinedExceptionData>())
 {}
@@ -262,16 +427,24 @@ DEFINE_CONSTMSG_EXCEPTION(
 
 namespace Detail {
 
-PrivateMemoryMap::~PrivateMemoryMap() noexcept {
-    for (auto const & vp : m_data)
-        ::operator delete(vp.first);
-}
+/*
+  The size of an idle process state on x86-64 with libstdc++ is 768 bytes, or
+  12 cache lines. Everything else a process needs is allocated on demand, so a
+  larger state is a regression:
+*/
+#if defined(__x86_64__) && defined(__GLIBCXX__)
+static_assert(sizeof(ProcessState) <= 12u * cacheLineSize, "");
+#endif
+
+PrivateMemoryMap::~PrivateMemoryMap() noexcept { clear(); }
 
 void * PrivateMemoryMap::allocate(std::size_t const nBytes) {
     assert(nBytes > 0u);
+    if (!m_data)
+        m_data.reset(new Allocations());
     auto const r = ::operator new(nBytes);
     try {
-        m_data.emplace(r, nBytes);
+        m_data->emplace(r, nBytes);
     } catch (...) {
         ::operator delete(r);
         throw;
@@ -279,13 +452,23 @@ void * PrivateMemoryMap::allocate(std::size_t const nBytes) {
     return r;
 }
 
+void PrivateMemoryMap::clear() noexcept {
+    if (!m_data)
+        return;
+    for (auto const & vp : *m_data)
+        ::operator delete(vp.first);
+    m_data.reset();
+}
+
 std::size_t PrivateMemoryMap::free(void * const ptr) noexcept {
-    auto it(m_data.find(ptr));
-    if (it == m_data.end())
+    if (!m_data)
+        return 0u;
+    auto it(m_data->find(ptr));
+    if (it == m_data->end())
         return 0u;
     auto const r(it->second);
     assert(r > 0u);
-    m_data.erase(it);
+    m_data->erase(it);
     ::operator delete(ptr);
     return r;
 }
@@ -300,84 +483,542 @@ ProcessState::SimpleMemoryMap::SimpleMemoryMap(
     insertSlot(3u, std::move(bssSection));
 }
 
-ProcessState::ProcessState(
-        std::shared_ptr<PreparedExecutable const> preparedExecutable)
-    : m_activeLinkingUnitIndex(
-          assertReturn(preparedExecutable)->activeLinkingUnitIndex)
+ProcessState::ProcessState(std::shared_ptr<ProgramState> programState,
+                           DataSectionBatch * const dataSectionBatch)
+    : m_programState(assertReturn(std::move(programState)))
+    , m_activeLinkingUnitIndex(
+          assertReturn(m_programState->m_preparedExecutable)
+                ->activeLinkingUnitIndex)
     , m_preparedLinkingUnit(
         [](std::shared_ptr<PreparedExecutable const> exePtr) noexcept {
             assert(exePtr);
-            auto const & activeLinkingUnit =
-                    exePtr->linkingUnits[exePtr->activeLinkingUnitIndex];
+            auto const & activeLinkingUnit = exePtr->activeLinkingUnit();
             return std::shared_ptr<PreparedLinkingUnit const>(
                         std::move(exePtr),
                         &activeLinkingUnit);
-        }(std::move(preparedExecutable)))
+        }(m_programState->m_preparedExecutable))
     , m_memoryMap(std::shared_ptr<RoDataSection const>(
                       m_preparedLinkingUnit,
                       &m_preparedLinkingUnit->roDataSection),
-                  std::make_shared<RwDataSection>(
-                      m_preparedLinkingUnit->rwDataSection),
-                  std::make_shared<BssDataSection>(
-                      m_preparedLinkingUnit->bssSectionSize))
-{}
+                  dataSectionBatch
+                  ? dataSectionBatch->newRwDataSection()
+                  : std::make_shared<RwDataSection>(
+                        m_preparedLinkingUnit->rwDataSection),
+                  dataSectionBatch
+                  ? dataSectionBatch->newBssDataSection()
+                  : std::make_shared<BssDataSection>(
+                        m_preparedLinkingUnit->bssSectionSize))
+{
+    if (currentCodeSection().countsOpcodes())
+        m_opcodeCounters = std::make_unique<OpcodeCounters>(
+                               currentCodeSection().numCountedOpcodes());
+    if (auto const numTimed =
+                m_preparedLinkingUnit->timedSyscallSignatures.size())
+        m_syscallStatistics =
+                std::make_unique<std::vector<Vm::SyscallStatistics> >(
+                    numTimed);
+}
+
+ProcessState::ProcessState(ProcessState const & copy)
+    : std::enable_shared_from_this<ProcessState>()
+    , m_programState(copy.m_programState)
+    , m_activeLinkingUnitIndex(copy.m_activeLinkingUnitIndex)
+    , m_preparedLinkingUnit(copy.m_preparedLinkingUnit)
+    , m_currentIp(copy.m_currentIp)
+    , m_frames(copy.m_frames)
+    , m_globalFrame(&m_frames.front())
+    , m_thisFrame(nullptr)
+    , m_fpuState(copy.m_fpuState)
+    , m_returnValue(copy.m_returnValue)
+    , m_memoryMap(copy.m_memoryMap)
+    , m_state(copy.m_state.load(std::memory_order_relaxed))
+    , m_pendingSyscallException(copy.m_pendingSyscallException)
+    , m_processFacilityFinder(copy.processFacilityFinder())
+    , m_memPublicHeap(copy.m_memPublicHeap)
+    , m_memPrivate(copy.m_memPrivate)
+    , m_memReserved(copy.m_memReserved)
+    , m_memTotal(copy.m_memTotal)
+    , m_ioBuffers(copy.m_ioBuffers
+                  ? new IoBuffers(*copy.m_ioBuffers)
+                  : nullptr)
+    , m_checkpointState(copy.m_checkpointState
+                        ? new CheckpointState(*copy.m_checkpointState)
+                        : nullptr)
+{
+    assert((m_state == State::Initialized) || (m_state == State::Trapped));
+
+    /* The clone starts counting from scratch: */
+    if (copy.m_opcodeCounters)
+        m_opcodeCounters = std::make_unique<OpcodeCounters>(
+                               copy.m_opcodeCounters->counts.size());
+    if (copy.m_syscallStatistics)
+        m_syscallStatistics =
+                std::make_unique<std::vector<Vm::SyscallStatistics> >(
+                    copy.m_syscallStatistics->size());
+
+    /* Private memory is owned by system calls, hence it is not copied: */
+    assert(m_memTotal.usage >= m_memPrivate.usage);
+    m_memTotal.usage -= m_memPrivate.usage;
+    m_memPrivate.usage = 0u;
+
+    AddressTranslator translator;
+    for (auto const & clonedSlot : m_memoryMap.cloneWritableSlots()) {
+        translator.addRange(clonedSlot.original->data(),
+                            clonedSlot.original->size(),
+                            clonedSlot.copy->data(),
+                            clonedSlot.copy);
+        if (m_ioBuffers)
+            for (auto & output : m_ioBuffers->outputs)
+                if (output.second == clonedSlot.original)
+                    output.second = clonedSlot.copy;
+    }
+
+    {
+        auto it(m_frames.begin());
+        for (auto const & frame : copy.m_frames) {
+            if (&frame == copy.m_thisFrame)
+                m_thisFrame = &*it;
+            if (&frame == copy.m_nextFrame)
+                m_nextFrame = &*it;
+            translator.addRange(frame.stack.data(),
+                                frame.stack.size() * sizeof(SharemindCodeBlock),
+                                it->stack.data());
+            ++it;
+        }
+    }
+    assert(m_thisFrame);
+    assert(!m_nextFrame == !copy.m_nextFrame);
+
+    /* Redirect references and return value pointers to the copied memory: */
+    for (auto & frame : m_frames) {
+        for (auto & ref : frame.refstack)
+            translator.translate(ref);
+        for (auto & cref : frame.crefstack)
+            translator.translate(cref);
+        if (frame.returnValueAddr)
+            frame.returnValueAddr = translator.translate(frame.returnValueAddr);
+    }
+}
 
 ProcessState::~ProcessState() noexcept {
-    assert(m_state != State::Starting);
     assert(m_state != State::Running);
+    if (m_opcodeCounters) {
+        try {
+            m_programState->m_vmState->addOpcodeCounts(opcodeCounts());
+        } catch (...) {} // The counts are lost
+    }
+    if (m_syscallStatistics) {
+        try {
+            auto const statistics(syscallStatistics());
+            m_programState->addSyscallStatistics(statistics);
+            m_programState->m_vmState->addSyscallStatistics(statistics);
+        } catch (...) {} // The statistics are lost
+    }
+}
+
+template <typename OnWrongState>
+void ProcessState::startRunning(State const expected,
+                                OnWrongState && onWrongState)
+{
+    /* Operations which require the process not to be running check its state
+       and do their work under the lock, hence claim the process under it: */
+    RUNSTATEGUARD;
+    if (unlikely(m_state.load(std::memory_order_relaxed) != expected))
+        onWrongState();
+    /* Samples requested while not running are not for this run: */
+    m_pendingSamples.store(0u, std::memory_order_relaxed);
+    m_state.store(State::Running, std::memory_order_relaxed);
+}
+
+Process::ExecutionResult ProcessState::run(std::uint64_t const fuel) {
+    startRunning(State::Initialized,
+                 [] { throw Process::NotInInitializedStateException(); });
+    m_fuel = fuel;
+    return execute(ExecuteMethod::Run);
+}
+
+Process::ExecutionResult ProcessState::resume(std::uint64_t const fuel) {
+    startRunning(State::Trapped,
+                 [] { throw Process::NotInTrappedStateException(); });
+    m_fuel = fuel;
+    return execute(ExecuteMethod::Continue);
 }
 
-void ProcessState::run() {
+Process::ExecutionResult ProcessState::call(
+        std::size_t const codeOffset,
+        StackFrame::RegisterVector arguments,
+        std::uint64_t const fuel)
+{
+    if (unlikely(!currentCodeSection().isInstructionAtOffset(codeOffset)))
+        throw Process::JumpToInvalidAddressException();
+    startRunning(State::Finished,
+                 [] { throw Process::NotInFinishedStateException(); });
+
+    /* Drop any frames left over from the last halt, but keep the globals: */
+    m_frames.erase(std::next(m_frames.begin()), m_frames.end());
+    m_nextFrame = nullptr;
+    m_thisFrame = m_globalFrame;
+    try {
+        m_frames.emplace_back();
+    } catch (...) {
+        m_state.store(State::Finished, std::memory_order_release);
+        notifyStopped();
+        throw;
+    }
+    auto & frame = m_frames.back();
+    frame.stack = std::move(arguments);
+    frame.returnAddr = nullptr; // Triggers halt on return
+    frame.returnValueAddr = nullptr;
+    m_thisFrame = &frame;
+    m_currentIp = codeOffset;
+    m_fuel = fuel;
+    return execute(ExecuteMethod::Run);
+}
+
+Process::ExecutionResult ProcessState::execute(
+        ExecuteMethod const executeMethod)
+{
+    assert((executeMethod == ExecuteMethod::Run)
+           || (executeMethod == ExecuteMethod::Continue));
+    assert(m_state == State::Running);
+
+    VmRunResult r;
+    try {
+        if (unlikely(m_pendingSyscallException)) {
+            /* The last system call failed asynchronously: */
+            m_syscallException = std::move(m_pendingSyscallException);
+            m_pendingSyscallException = nullptr;
+            try {
+                std::rethrow_exception(m_syscallException);
+            } catch (...) {
+                std::throw_with_nested(Process::SystemCallErrorException());
+            }
+        }
+        r = vmRun(executeMethod, this);
+    } catch (...) {
+        m_state.store(State::Crashed, std::memory_order_release);
+        notifyStopped();
+        throw;
+    }
+
+    switch (r) {
+    case VmRunResult::Halted:
+        m_state.store(State::Finished, std::memory_order_release);
+        notifyStopped();
+        return Process::ExecutionResult::Finished;
+    case VmRunResult::Trapped:
+        m_state.store(State::Trapped, std::memory_order_release);
+        notifyStopped();
+        return Process::ExecutionResult::Trapped;
+    case VmRunResult::FuelExhausted:
+        m_state.store(State::Trapped, std::memory_order_release);
+        notifyStopped();
+        return Process::ExecutionResult::FuelExhausted;
+    case VmRunResult::Cancelled:
+        m_state.store(State::Crashed, std::memory_order_release);
+        notifyStopped();
+        throw Process::CancelledException();
+    case VmRunResult::Held:
     {
         RUNSTATEGUARD;
-        if (unlikely(m_state != State::Initialized))
-            throw Process::NotInInitializedStateException();
-        m_state = State::Starting;
+        m_state.store(State::Trapped, std::memory_order_release);
+        m_stoppedCondition.notify_all();
+        /* Unless released before we got here, release() wakes it up: */
+        if (!(m_attention.load(std::memory_order_acquire) & AttentionHold))
+            return Process::ExecutionResult::Trapped;
+        m_stoppedByHold = true;
+        return Process::ExecutionResult::Held;
+    }
+    case VmRunResult::Suspended:
+        break;
+    case VmRunResult::Continue:
+        assert(false);
+        break;
     }
 
+    std::function<void ()> wakeupCallback;
     {
         RUNSTATEGUARD;
-        assert(m_state == State::Starting);
-        m_state = State::Running;
+        assert(m_pendingSyscall);
+        if (m_pendingSyscall->completed) {
+            /* Completed already before we got here: */
+            finishPendingSyscall();
+            m_state.store(State::Trapped, std::memory_order_release);
+            wakeupCallback = m_wakeupCallback;
+        } else {
+            m_state.store(State::Suspended, std::memory_order_release);
+        }
+        m_stoppedCondition.notify_all();
     }
-    return execute(ExecuteMethod::Run);
+    if (wakeupCallback)
+        wakeupCallback();
+    return Process::ExecutionResult::Suspended;
+}
+
+Vm::PendingSyscall ProcessState::suspendSyscall() {
+    if (!m_pendingSyscall)
+        m_pendingSyscall =
+                std::make_shared<Vm::PendingSyscall::Inner>(
+                    shared_from_this());
+    return Vm::PendingSyscall(m_pendingSyscall);
 }
 
-void ProcessState::resume() {
+void ProcessState::completeSyscall(Vm::PendingSyscall::Inner & pendingSyscall,
+                                   SharemindCodeBlock const * returnValue,
+                                   std::exception_ptr exception) noexcept
+{
+    std::function<void ()> wakeupCallback;
     {
         RUNSTATEGUARD;
-        if (unlikely(m_state != State::Trapped))
-            throw Process::NotInTrappedStateException();
-        m_state = State::Running;
+        if (pendingSyscall.completed)
+            return;
+        pendingSyscall.completed = true;
+        if (m_syscallStatistics)
+            pendingSyscall.completionTime = std::chrono::steady_clock::now();
+        if (returnValue) {
+            pendingSyscall.hasReturnValue = true;
+            pendingSyscall.returnValue = *returnValue;
+        }
+        pendingSyscall.exception = std::move(exception);
+
+        /* Otherwise execute() finishes the system call: */
+        if (m_state != State::Suspended)
+            return;
+        assert(m_pendingSyscall.get() == &pendingSyscall);
+        finishPendingSyscall();
+        m_state = State::Trapped;
+        wakeupCallback = m_wakeupCallback;
     }
-    return execute(ExecuteMethod::Continue);
+    if (wakeupCallback)
+        wakeupCallback();
 }
 
-void ProcessState::execute(ExecuteMethod const executeMethod) {
-    assert((executeMethod == ExecuteMethod::Run)
-           || (executeMethod == ExecuteMethod::Continue));
+void ProcessState::finishPendingSyscall() noexcept {
+    assert(m_pendingSyscall);
+    assert(m_pendingSyscall->completed);
+    assert(m_nextFrame == &m_frames.back());
+    auto & pendingSyscall = *m_pendingSyscall;
+    if (pendingSyscall.hasReturnValue && m_pendingSyscallReturnValueAddr)
+        *m_pendingSyscallReturnValueAddr = pendingSyscall.returnValue;
+    if (pendingSyscall.timedBindingIndex
+        != Vm::PendingSyscall::Inner::notTimed)
+        recordSyscall(pendingSyscall.timedBindingIndex,
+                      pendingSyscall.completionTime
+                      - pendingSyscall.startTime);
+    m_pendingSyscallException = std::move(pendingSyscall.exception);
+    m_pendingSyscallReturnValueAddr = nullptr;
+    m_pendingSyscall.reset();
+    m_frames.pop_back();
+    m_nextFrame = nullptr;
+}
 
-    auto const setState =
-            [this](State const newState) noexcept {
-                RUNSTATEGUARD;
-                assert(m_state == State::Running);
-                m_state = newState;
-            };
+void ProcessState::abandonPendingSyscall() noexcept {
+    RUNSTATEGUARD;
+    assert(m_pendingSyscall);
+    m_pendingSyscall->completed = true;
+    m_pendingSyscall.reset();
+}
 
-    try {
-        vmRun(executeMethod, this);
-    } catch (Process::TrapException const &) {
-        setState(State::Trapped);
-        throw;
-    } catch (...) {
-        setState(State::Crashed);
-        throw;
+void ProcessState::reset() {
+    RUNSTATEGUARD;
+    {
+        auto const state = m_state.load(std::memory_order_relaxed);
+        if (unlikely((state != State::Finished) && (state != State::Crashed)))
+            throw Process::NotInFinishedOrCrashedStateException();
+    }
+
+    /* Restore the data sections in place: */
+    auto const & rwDataSection = m_preparedLinkingUnit->rwDataSection;
+    if (auto const size = rwDataSection.size()) {
+        auto const & slot = m_memoryMap.get(2u);
+        assert(slot && (slot->size() == size));
+        std::memcpy(slot->data(), rwDataSection.data(), size);
     }
-    setState(State::Finished);
+    if (auto const & slot = m_memoryMap.get(3u))
+        std::memset(slot->data(), 0, slot->size());
+
+    m_memoryMap.freeAllocated();
+    m_privateMemoryMap.clear();
+    m_ioBuffers.reset();
+    m_checkpointState.reset();
+    if (m_opcodeCounters)
+        m_opcodeCounters->previous = OpcodeCounters::noPrevious;
+    for (auto * const memInfo
+         : {&m_memPublicHeap, &m_memPrivate, &m_memReserved, &m_memTotal})
+    {
+        memInfo->usage = 0u;
+        memInfo->max = 0u;
+    }
+
+    /* Keep the global frame and the capacity of its stacks: */
+    m_frames.erase(std::next(m_frames.begin()), m_frames.end());
+    assert(m_globalFrame == &m_frames.front());
+    m_globalFrame->stack.clear();
+    m_globalFrame->refstack.clear();
+    m_globalFrame->crefstack.clear();
+    m_globalFrame->returnAddr = nullptr;
+    m_globalFrame->returnValueAddr = nullptr;
+    m_nextFrame = nullptr;
+    m_thisFrame = m_globalFrame;
+
+    m_currentIp = 0u;
+    m_returnValue.uint64[0] = 0u;
+    m_syscallException = nullptr;
+    m_fpuState = initialFpuState;
+    /* Holds by process groups persist, cancellations end with the run: */
+    m_attention.fetch_and(AttentionHold, std::memory_order_relaxed);
+    m_state.store(State::Initialized, std::memory_order_relaxed);
 }
 
 void ProcessState::pause() noexcept
-{ m_trapCond.store(true, std::memory_order_release); }
+{ m_attention.fetch_or(AttentionPause, std::memory_order_release); }
+
+void ProcessState::hold() noexcept {
+    RUNSTATEGUARD;
+    if (!m_numHolds++)
+        m_attention.fetch_or(AttentionHold, std::memory_order_release);
+}
+
+void ProcessState::release() noexcept {
+    std::function<void ()> wakeupCallback;
+    {
+        RUNSTATEGUARD;
+        assert(m_numHolds);
+        if (--m_numHolds)
+            return;
+        m_attention.fetch_and(~AttentionHold, std::memory_order_release);
+        if (!m_stoppedByHold)
+            return;
+        m_stoppedByHold = false;
+        wakeupCallback = m_wakeupCallback;
+    }
+    if (wakeupCallback)
+        wakeupCallback();
+}
+
+void ProcessState::cancel() noexcept {
+    std::function<void ()> wakeupCallback;
+    {
+        RUNSTATEGUARD;
+        m_attention.fetch_or(AttentionCancel, std::memory_order_release);
+        /* Held processes are woken up to be cancelled, but stay held: */
+        if (!m_stoppedByHold)
+            return;
+        m_stoppedByHold = false;
+        wakeupCallback = m_wakeupCallback;
+    }
+    if (wakeupCallback)
+        wakeupCallback();
+}
+
+void ProcessState::requestSample() noexcept {
+    m_pendingSamples.fetch_add(1u, std::memory_order_relaxed);
+    m_attention.fetch_or(AttentionSample, std::memory_order_release);
+}
+
+void ProcessState::setProfiler(std::shared_ptr<ProfilerState> profiler)
+        noexcept
+{ std::atomic_store(&m_profiler, std::move(profiler)); }
+
+void ProcessState::detachProfiler(ProfilerState const * const profiler)
+        noexcept
+{
+    auto expected(std::atomic_load(&m_profiler));
+    if (expected.get() == profiler)
+        std::atomic_compare_exchange_strong(&m_profiler,
+                                            &expected,
+                                            std::shared_ptr<ProfilerState>());
+}
+
+void ProcessState::waitUntilStopped() const {
+    m_numStoppedWaiters.fetch_add(1u);
+    {
+        std::unique_lock<std::mutex> lock(m_runStateMutex);
+        m_stoppedCondition.wait(
+                    lock,
+                    [this]() noexcept
+                    { return m_state.load() != State::Running; });
+    }
+    m_numStoppedWaiters.fetch_sub(1u, std::memory_order_relaxed);
+}
+
+bool ProcessState::waitUntilStopped(
+        std::chrono::steady_clock::time_point const deadline) const
+{
+    m_numStoppedWaiters.fetch_add(1u);
+    bool r;
+    {
+        std::unique_lock<std::mutex> lock(m_runStateMutex);
+        r = m_stoppedCondition.wait_until(
+                    lock,
+                    deadline,
+                    [this]() noexcept
+                    { return m_state.load() != State::Running; });
+    }
+    m_numStoppedWaiters.fetch_sub(1u, std::memory_order_relaxed);
+    return r;
+}
+
+void ProcessState::notifyStopped() noexcept {
+    /*
+      Pairs with the increment of m_numStoppedWaiters before the state is
+      checked by the waiter, so that either the waiter sees the new state or we
+      see the waiter:
+    */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!m_numStoppedWaiters.load(std::memory_order_relaxed))
+        return;
+    {
+        /* Synchronize with waiters checking the predicate before waiting: */
+        RUNSTATEGUARD;
+    }
+    m_stoppedCondition.notify_all();
+}
+
+VmRunResult ProcessState::handleAttention() noexcept {
+    auto attention = m_attention.load(std::memory_order_acquire);
+    if (attention & AttentionSample) {
+        /* Clear the bit first, so that no request is left without one: */
+        attention = m_attention.fetch_and(~AttentionSample,
+                                          std::memory_order_acquire);
+        if (auto const weight =
+                    m_pendingSamples.exchange(0u, std::memory_order_relaxed))
+            takeSample(weight);
+    }
+    if (attention & AttentionCancel)
+        return VmRunResult::Cancelled;
+    if (!m_fuel)
+        return VmRunResult::FuelExhausted;
+    if (attention & AttentionHold) {
+        /* Stopping for the hold also serves pending pause requests: */
+        m_attention.fetch_and(~AttentionPause, std::memory_order_relaxed);
+        return VmRunResult::Held;
+    }
+    if (m_attention.fetch_and(~AttentionPause, std::memory_order_acquire)
+        & AttentionPause)
+        return VmRunResult::Trapped;
+    return VmRunResult::Continue;
+}
+
+void ProcessState::takeSample(std::uint64_t const weight) noexcept {
+    auto const profiler(std::atomic_load(&m_profiler));
+    if (!profiler)
+        return;
+    try {
+        /* The return addresses of the frames below the current one: */
+        auto const codeStart = currentCodeSection().constData();
+        std::vector<std::size_t> stack;
+        for (auto const & frame : m_frames) {
+            if (frame.returnAddr)
+                stack.emplace_back(
+                        static_cast<std::size_t>(frame.returnAddr - codeStart));
+            if (&frame == m_thisFrame)
+                break;
+        }
+        stack.emplace_back(m_currentIp);
+        profiler->addSample(m_preparedLinkingUnit, std::move(stack), weight);
+    } catch (...) {} // The sample is lost
+}
 
 std::uint64_t ProcessState::publicAlloc(std::uint64_t const nBytes) {
     /* Check memory limits: */
@@ -423,6 +1064,155 @@ std::size_t ProcessState::publicSlotSize(std::uint64_t const ptr)
 void * ProcessState::publicSlotPtr(std::uint64_t const ptr) const noexcept
 { return m_memoryMap.slotPtr(ptr); }
 
+void ProcessState::setInput(std::string name,
+                            std::shared_ptr<void const> data,
+                            std::size_t const size)
+{
+    RUNSTATEGUARD;
+    {
+        auto const state = m_state.load(std::memory_order_relaxed);
+        if (unlikely((state != State::Initialized)
+                     && (state != State::Finished)))
+            throw Process::NotInInitializedOrFinishedStateException();
+    }
+
+    MemoryMap::ValueType slot(
+                std::make_shared<InputMemory>(std::move(data), size));
+    auto const ptr(m_memoryMap.insert(slot));
+    Input * input;
+    try {
+        input = &ioBuffers().inputs[std::move(name)];
+    } catch (...) {
+        m_memoryMap.free(ptr);
+        throw;
+    }
+
+    /* Release the replaced input, unless the bytecode already freed it: */
+    if (input->slot && (m_memoryMap.get(input->ptr) == input->slot))
+        publicFree(input->ptr);
+    input->ptr = ptr;
+    input->slot = std::move(slot);
+
+    /* Update memory statistics, but inputs are not subject to the limits: */
+    addPublicMemoryUsage(size);
+}
+
+void ProcessState::addPublicMemoryUsage(std::size_t const size) noexcept {
+    m_memPublicHeap.usage += size;
+    m_memTotal.usage += size;
+    if (m_memPublicHeap.usage > m_memPublicHeap.max)
+        m_memPublicHeap.max = m_memPublicHeap.usage;
+    if (m_memTotal.usage > m_memTotal.max)
+        m_memTotal.max = m_memTotal.usage;
+}
+
+std::uint64_t ProcessState::inputPtr(std::string const & name) const noexcept {
+    if (!m_ioBuffers)
+        return 0u;
+    auto const & inputs = m_ioBuffers->inputs;
+    auto const it(inputs.find(name));
+    if ((it == inputs.end())
+        || (m_memoryMap.get(it->second.ptr) != it->second.slot))
+        return 0u;
+    return it->second.ptr;
+}
+
+std::uint64_t ProcessState::sharedSegmentPtr(std::string const & name) {
+    if (m_ioBuffers) {
+        auto const & segments = m_ioBuffers->sharedSegments;
+        auto const it(segments.find(name));
+        if ((it != segments.end())
+            && it->second.slot
+            && (m_memoryMap.get(it->second.ptr) == it->second.slot))
+            return it->second.ptr;
+    }
+
+    auto slot(m_programState->sharedSegment(name));
+    if (!slot)
+        return 0u;
+    auto & input = ioBuffers().sharedSegments[name];
+    auto const size = slot->size();
+    input.ptr = m_memoryMap.insert(slot);
+    input.slot = std::move(slot);
+
+    /* Update memory statistics, but segments are not subject to the limits: */
+    addPublicMemoryUsage(size);
+    return input.ptr;
+}
+
+void ProcessState::setOutput(std::string name, std::uint64_t const ptr) {
+    auto const & slot = m_memoryMap.get(ptr);
+    if (!slot)
+        throw Process::InvalidMemoryHandleException();
+    ioBuffers().outputs[std::move(name)] = slot;
+}
+
+ProcessState::IoBuffers & ProcessState::ioBuffers() {
+    if (!m_ioBuffers)
+        m_ioBuffers.reset(new IoBuffers());
+    return *m_ioBuffers;
+}
+
+Vm::ConstReference ProcessState::output(std::string const & name) const {
+    if (!m_ioBuffers)
+        return Vm::ConstReference(nullptr, 0u);
+    auto const & outputs = m_ioBuffers->outputs;
+    auto const it(outputs.find(name));
+    if (it == outputs.end())
+        return Vm::ConstReference(nullptr, 0u);
+    auto const & slot = it->second;
+    return Vm::ConstReference(std::shared_ptr<void const>(slot, slot->data()),
+                              slot->size());
+}
+
+std::uint64_t ProcessState::transferMemory(std::uint64_t const ptr,
+                                           ProcessState & target,
+                                           Process::TransferMode const mode)
+{
+    /* Data sections are not transferable: */
+    if (unlikely(ptr < MemoryMap::numReservedPointers))
+        throw Process::InvalidMemoryHandleException();
+    auto slot(m_memoryMap.get(ptr));
+    if (unlikely(!slot))
+        throw Process::InvalidMemoryHandleException();
+
+    /*
+      Writable memory must not be referenced by this process, since it will
+      either be writable by the target process or read-only. Note that slot is
+      one of the two references expected here:
+    */
+    if (unlikely(slot->isWritable() && (slot.use_count() > 2)))
+        throw Process::MemoryInUseException();
+
+    auto const size = slot->size();
+    if (mode == Process::TransferMode::Move) {
+        if (unlikely((target.m_memTotal.upperLimit - target.m_memTotal.usage
+                      < size)
+                     || (target.m_memPublicHeap.upperLimit
+                         - target.m_memPublicHeap.usage < size)))
+            return 0u;
+        auto const targetPtr = target.m_memoryMap.insert(std::move(slot));
+        target.addPublicMemoryUsage(size);
+        auto const r(publicFree(ptr));
+        static_cast<void>(r);
+        assert(r == MemoryMap::Ok);
+        return targetPtr;
+    }
+
+    /* Shared memory must be read-only in both processes: */
+    assert(mode == Process::TransferMode::Share);
+    MemoryMap::ValueType sharedSlot(slot);
+    if (slot->isWritable())
+        sharedSlot = std::make_shared<InputMemory>(
+                         std::shared_ptr<void const>(slot, slot->data()),
+                         size);
+    auto const targetPtr = target.m_memoryMap.insert(sharedSlot);
+    target.addPublicMemoryUsage(size);
+    if (sharedSlot != slot)
+        m_memoryMap.replace(ptr, std::move(sharedSlot));
+    return targetPtr;
+}
+
 void * ProcessState::privateAlloc(std::size_t const nBytes) {
     assert(nBytes > 0u);
 
@@ -497,33 +1287,323 @@ bool ProcessState::privateRelease(std::size_t const nBytes) {
 std::shared_ptr<void> ProcessState::findProcessFacility(char const * name)
         const noexcept
 {
-    if (m_processFacilityFinder && *m_processFacilityFinder)
-        return (*m_processFacilityFinder)(name);
+    auto const finder(processFacilityFinder());
+    if (finder && *finder)
+        return (*finder)(name);
     return m_programState->findProcessFacility(name);
 }
 
+Vm::FacilityFinderFunPtr ProcessState::processFacilityFinder() const noexcept {
+    std::lock_guard<std::mutex> const guard(m_facilityFinderMutex);
+    return m_processFacilityFinder;
+}
+
+ProcessState::OpcodeCounters::OpcodeCounters(std::size_t const numOpcodes)
+    : counts(numOpcodes, 0u)
+{
+    if (numOpcodes
+        && (numOpcodes > std::numeric_limits<std::size_t>::max() / numOpcodes))
+        throw std::bad_alloc();
+    pairCounts.resize(numOpcodes * numOpcodes, 0u);
+}
+
+void ProcessState::countOpcode(std::size_t const offset) noexcept {
+    assert(m_opcodeCounters);
+    auto & counters = *m_opcodeCounters;
+    auto const opcode = currentCodeSection().countedOpcode(offset);
+    auto const numOpcodes = counters.counts.size();
+    assert(opcode < numOpcodes);
+    ++counters.counts[opcode];
+    if (counters.previous != OpcodeCounters::noPrevious)
+        ++counters.pairCounts[counters.previous * numOpcodes + opcode];
+    counters.previous = opcode;
+}
+
+Vm::OpcodeCounts ProcessState::opcodeCounts() const {
+    Vm::OpcodeCounts r;
+    if (!m_opcodeCounters)
+        return r;
+    auto const & codeSection = currentCodeSection();
+    auto const & counters = *m_opcodeCounters;
+    auto const code =
+            [&codeSection](std::uint64_t const opcode) noexcept {
+                return codeSection.countedOpcodeInfo(
+                            static_cast<std::uint32_t>(opcode)).code;
+            };
+    auto const numOpcodes = counters.counts.size();
+    for (std::size_t i = 0u; i < numOpcodes; ++i)
+        if (counters.counts[i])
+            r.instructions.emplace(code(i), counters.counts[i]);
+    for (std::size_t i = 0u; i < counters.pairCounts.size(); ++i)
+        if (counters.pairCounts[i])
+            r.instructionPairs.emplace(
+                        std::make_pair(code(i / numOpcodes),
+                                       code(i % numOpcodes)),
+                        counters.pairCounts[i]);
+    return r;
+}
+
+void ProcessState::recordSyscall(std::size_t const bindingIndex,
+                                 std::chrono::nanoseconds const latency)
+        noexcept
+{
+    assert(m_syscallStatistics);
+    assert(bindingIndex < m_syscallStatistics->size());
+    auto & statistics = (*m_syscallStatistics)[bindingIndex];
+    ++statistics.calls;
+    statistics.totalTime += latency;
+    if (latency > statistics.maxTime)
+        statistics.maxTime = latency;
+
+    /* The bucket is the bit width of the latency in nanoseconds: */
+    assert(latency.count() >= 0);
+    auto const ns = static_cast<unsigned long long>(latency.count());
+    std::size_t bucket =
+            ns ? (64u - static_cast<std::size_t>(__builtin_clzll(ns))) : 0u;
+    if (bucket >= Vm::SyscallStatistics::numHistogramBuckets)
+        bucket = Vm::SyscallStatistics::numHistogramBuckets - 1u;
+    ++statistics.histogram[bucket];
+}
+
+bool ProcessState::deferSyscallTiming(
+        std::size_t const bindingIndex,
+        std::chrono::steady_clock::time_point const start) noexcept
+{
+    /*
+      Only the process sets and finishes the pending system call while it is
+      running:
+    */
+    if (!m_pendingSyscall)
+        return false;
+    m_pendingSyscall->timedBindingIndex = bindingIndex;
+    m_pendingSyscall->startTime = start;
+    return true;
+}
+
+Vm::SyscallStatisticsMap ProcessState::syscallStatistics() const {
+    Vm::SyscallStatisticsMap r;
+    if (!m_syscallStatistics)
+        return r;
+    auto const & signatures = m_preparedLinkingUnit->timedSyscallSignatures;
+    assert(signatures.size() == m_syscallStatistics->size());
+    for (std::size_t i = 0u; i < signatures.size(); ++i)
+        if ((*m_syscallStatistics)[i].calls)
+            r[signatures[i]] += (*m_syscallStatistics)[i];
+    return r;
+}
+
+std::shared_ptr<void> ProcessState::findProcessFacilityMemoized(
+        char const * name) noexcept
+{
+    assert(name);
+    /* Read the generations before the lookup, so that memoized results of a
+       lookup racing with a finder change are invalidated on the next call: */
+    auto const vmGeneration =
+            m_programState->m_vmState->m_facilityFinderGeneration.load(
+                std::memory_order_acquire);
+    auto const programGeneration =
+            m_programState->m_facilityFinderGeneration.load(
+                std::memory_order_acquire);
+    auto const processGeneration =
+            m_facilityFinderGeneration.load(std::memory_order_acquire);
+    auto & memo = m_facilityMemo;
+    if (unlikely((memo.vmGeneration != vmGeneration)
+                 || (memo.programGeneration != programGeneration)
+                 || (memo.processGeneration != processGeneration)))
+    {
+        memo.entries.clear();
+        memo.vmGeneration = vmGeneration;
+        memo.programGeneration = programGeneration;
+        memo.processGeneration = processGeneration;
+    } else {
+        for (auto const & entry : memo.entries)
+            if (std::strcmp(entry.name.c_str(), name) == 0)
+                return entry.facility;
+    }
+
+    auto facility(findProcessFacility(name));
+    if (facility) {
+        try {
+            memo.entries.emplace_back(FacilityMemo::Entry{name, facility});
+        } catch (...) {} // Memoization is optional
+    }
+    return facility;
+}
+
+void ProcessState::setProcessFacilityFinder(Vm::FacilityFinderFunPtr f)
+        noexcept
+{
+    {
+        std::lock_guard<std::mutex> const guard(m_facilityFinderMutex);
+        m_processFacilityFinder = std::move(f);
+    }
+    m_facilityFinderGeneration.fetch_add(1u, std::memory_order_release);
+}
+
 } /* namespace Detail { */
 
 
-Process::Inner::Inner(std::shared_ptr<Program::Inner> programInner)
-    : ProcessState(assertReturn(programInner)->m_preparedExecutable)
+Process::Inner::Inner(std::shared_ptr<Program::Inner> programInner,
+                      Detail::DataSectionBatch * const dataSectionBatch)
+    : ProcessState(std::move(programInner), dataSectionBatch)
 {}
 
+Process::Inner::Inner(Inner const & copy) : ProcessState(copy) {}
+
 Process::Inner::~Inner() noexcept {}
 
 
 Process::Process(Program & program)
-    : m_inner(std::make_shared<Inner>(assertReturn(program.m_inner)))
+    : m_inner(std::allocate_shared<Inner>(
+                  Detail::CacheAlignedAllocator<Inner>(),
+                  assertReturn(program.m_inner)))
+{}
+
+Vm::PendingSyscall::~PendingSyscall() noexcept {}
+
+void Vm::PendingSyscall::complete() noexcept {
+    assert(m_inner);
+    if (auto const process = m_inner->process.lock())
+        process->completeSyscall(*m_inner, nullptr, nullptr);
+}
+
+void Vm::PendingSyscall::complete(SharemindCodeBlock returnValue) noexcept {
+    assert(m_inner);
+    if (auto const process = m_inner->process.lock())
+        process->completeSyscall(*m_inner, &returnValue, nullptr);
+}
+
+void Vm::PendingSyscall::fail(std::exception_ptr exception) noexcept {
+    assert(m_inner);
+    assert(exception);
+    if (auto const process = m_inner->process.lock())
+        process->completeSyscall(*m_inner, nullptr, std::move(exception));
+}
+
+
+Process::Process(std::shared_ptr<Inner> inner) noexcept
+    : m_inner(std::move(inner))
 {}
 
 Process::~Process() noexcept {}
 
-void Process::run() { return m_inner->run(); }
+void Process::run() { return throwUnlessFinished(tryRun()); }
+
+void Process::runFor(std::uint64_t const fuel)
+{ return throwUnlessFinished(tryRun(fuel)); }
+
+void Process::resume() { return throwUnlessFinished(tryResume()); }
+
+void Process::resumeFor(std::uint64_t const fuel)
+{ return throwUnlessFinished(tryResume(fuel)); }
+
+Process::ExecutionResult Process::tryRun(std::uint64_t const fuel)
+{ return m_inner->run(fuel); }
 
-void Process::resume() { return m_inner->resume(); }
+Process::ExecutionResult Process::tryResume(std::uint64_t const fuel)
+{ return m_inner->resume(fuel); }
+
+SharemindCodeBlock Process::call(std::size_t const codeOffset,
+                                 std::vector<SharemindCodeBlock> arguments)
+{
+    throwUnlessFinished(tryCall(codeOffset, std::move(arguments)));
+    return m_inner->m_returnValue;
+}
+
+void Process::setInput(std::string name,
+                       std::shared_ptr<void const> data,
+                       std::size_t const size)
+{ return m_inner->setInput(std::move(name), std::move(data), size); }
+
+Vm::ConstReference Process::output(std::string const & name) const
+{ return m_inner->output(name); }
+
+std::uint64_t Process::transferMemory(std::uint64_t const ptr,
+                                      Process & target,
+                                      TransferMode const mode)
+{
+    if (unlikely(target.m_inner == m_inner))
+        throw InvalidArgumentException();
+    std::lock(m_inner->m_runStateMutex, target.m_inner->m_runStateMutex);
+    std::lock_guard<std::mutex> const guard(m_inner->m_runStateMutex,
+                                            std::adopt_lock);
+    std::lock_guard<std::mutex> const targetGuard(
+                target.m_inner->m_runStateMutex,
+                std::adopt_lock);
+    for (auto const * const inner : {m_inner.get(), target.m_inner.get()}) {
+        auto const state = inner->m_state.load(std::memory_order_acquire);
+        if (unlikely((state != Inner::State::Initialized)
+                     && (state != Inner::State::Trapped)
+                     && (state != Inner::State::Finished)))
+            throw NotInInitializedTrappedOrFinishedStateException();
+    }
+    return m_inner->transferMemory(ptr, *target.m_inner, mode);
+}
+
+Process::ExecutionResult Process::tryCall(
+        std::size_t const codeOffset,
+        std::vector<SharemindCodeBlock> arguments,
+        std::uint64_t const fuel)
+{ return m_inner->call(codeOffset, std::move(arguments), fuel); }
 
 void Process::pause() noexcept { return m_inner->pause(); }
 
+void Process::reset() { return m_inner->reset(); }
+
+void Process::setWakeupCallback(std::function<void ()> callback) {
+    std::lock_guard<std::mutex> const guard(m_inner->m_runStateMutex);
+    m_inner->m_wakeupCallback = std::move(callback);
+}
+
+Process Process::clone() const {
+    std::lock_guard<std::mutex> const guard(m_inner->m_runStateMutex);
+    auto const state = m_inner->m_state.load(std::memory_order_acquire);
+    if (unlikely((state != Inner::State::Initialized)
+                 && (state != Inner::State::Trapped)))
+        throw NotInInitializedOrTrappedStateException();
+    return Process(std::allocate_shared<Inner>(
+                       Detail::CacheAlignedAllocator<Inner>(),
+                       *m_inner));
+}
+
+void Process::checkpoint(std::ostream & os, bool const incremental) {
+    std::lock_guard<std::mutex> const guard(m_inner->m_runStateMutex);
+    auto const state = m_inner->m_state.load(std::memory_order_acquire);
+    if (unlikely((state != Inner::State::Initialized)
+                 && (state != Inner::State::Trapped)))
+        throw NotInInitializedOrTrappedStateException();
+    return m_inner->writeCheckpoint(os, incremental);
+}
+
+Process Process::restore(Program & program, std::istream & is) {
+    auto inner(std::allocate_shared<Inner>(
+                   Detail::CacheAlignedAllocator<Inner>(),
+                   assertReturn(program.m_inner)));
+    inner->readCheckpoint(is, nullptr);
+    return Process(std::move(inner));
+}
+
+Process Process::restore(Program & program,
+                         std::istream & is,
+                         Process const & base)
+{
+    auto inner(std::allocate_shared<Inner>(
+                   Detail::CacheAlignedAllocator<Inner>(),
+                   assertReturn(program.m_inner)));
+    std::lock_guard<std::mutex> const guard(base.m_inner->m_runStateMutex);
+    if (unlikely(base.m_inner->m_state.load(std::memory_order_acquire)
+                 == Inner::State::Running))
+        throw CheckpointBaseMismatchException();
+    inner->readCheckpoint(is, base.m_inner.get());
+    return Process(std::move(inner));
+}
+
+Vm::OpcodeCounts Process::opcodeCounts() const
+{ return m_inner->opcodeCounts(); }
+
+Vm::SyscallStatisticsMap Process::syscallStatistics() const
+{ return m_inner->syscallStatistics(); }
+
 SharemindCodeBlock Process::returnValue() const noexcept
 { return m_inner->m_returnValue; }
 
@@ -537,7 +1617,7 @@ std::size_t Process::currentIp() const noexcept
 { return m_inner->m_currentIp; }
 
 void Process::setFacilityFinder(Vm::FacilityFinderFunPtr f) noexcept
-{ m_inner->m_processFacilityFinder = std::move(f); }
+{ return m_inner->setProcessFacilityFinder(std::move(f)); }
 
 std::shared_ptr<void> Process::findFacility(char const * name) const noexcept
 { return m_inner->findProcessFacility(name); }
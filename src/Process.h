@@ -22,21 +22,31 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <limits>
 #include <memory>
 #include <sharemind/codeblock.h>
 #include <sharemind/Exception.h>
 #include <sharemind/ExceptionMacros.h>
 #include <string>
 #include <type_traits>
+#include <vector>
 #include "Vm.h"
 
 
 namespace sharemind {
 
 class Program;
+class Scheduler;
 
 class Process {
 
+    friend class Program;
+    friend class ProcessGroup;
+    friend class Profiler;
+    friend class Scheduler;
+
 private: /* Types: */
 
     struct Inner;
@@ -50,9 +60,46 @@ public: /* Types: */
             NotInInitializedStateException);
     SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(InvalidInputStateException,
                                                    NotInTrappedStateException);
+    SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(
+            InvalidInputStateException,
+            NotInInitializedOrTrappedStateException);
+    SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(
+            InvalidInputStateException,
+            NotInFinishedOrCrashedStateException);
+    SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(InvalidInputStateException,
+                                                   NotInFinishedStateException);
+    SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(
+            InvalidInputStateException,
+            NotInInitializedOrFinishedStateException);
+    SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(
+            InvalidInputStateException,
+            NotInInitializedTrappedOrFinishedStateException);
+    SHAREMIND_DECLARE_EXCEPTION_NOINLINE(Exception, CheckpointException);
+    SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(CheckpointException,
+                                                   CheckpointIoException);
+    SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(
+            CheckpointException,
+            UncheckpointableStateException);
+    SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(CheckpointException,
+                                                   InvalidCheckpointException);
+    SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(
+            CheckpointException,
+            CheckpointBaseMismatchException);
+    SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(
+            CheckpointException,
+            CheckpointSharedSegmentMismatchException);
+    SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(
+            CheckpointException,
+            CheckpointMemoryLimitException);
     SHAREMIND_DECLARE_EXCEPTION_NOINLINE(Exception, RuntimeException);
     SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(RuntimeException,
                                                    TrapException);
+    SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(TrapException,
+                                                   FuelExhaustedException);
+    SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(RuntimeException,
+                                                   SyscallPendingException);
+    SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(RuntimeException,
+                                                   CancelledException);
     SHAREMIND_DECLARE_EXCEPTION_NOINLINE(RuntimeException,
                                          RegularRuntimeException);
     SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(RegularRuntimeException,
@@ -159,6 +206,43 @@ public: /* Types: */
             FloatingPointException,
             UnknownFloatingPointException);
 
+    /** \brief The reason why tryRun() or tryResume() returned. */
+    enum class ExecutionResult {
+        /** The process halted and is in finished state. */
+        Finished,
+        /** The process was paused or executed a trap instruction. */
+        Trapped,
+        /** The process ran out of fuel, see runFor(). */
+        FuelExhausted,
+        /** The process is suspended in an asynchronous system call. */
+        Suspended,
+        /**
+          The process is held by a paused ProcessGroup and is in trapped
+          state. Resuming it returns Held again until the group is resumed,
+          whereupon the wakeup callback of the process is called.
+        */
+        Held
+    };
+
+    /** \brief How transferMemory() passes memory to the target process. */
+    enum class TransferMode {
+        /**
+          The memory is removed from this process and added to the target
+          process as it is, i.e. writable memory stays writable.
+        */
+        Move,
+        /**
+          The memory is shared read-only by both processes. If it was
+          writable, it becomes read-only in this process as well.
+        */
+        Share
+    };
+
+public: /* Constants: */
+
+    static constexpr std::uint64_t const unlimitedFuel =
+            std::numeric_limits<std::uint64_t>::max();
+
 public: /* Methods: */
 
     /**
@@ -194,9 +278,265 @@ public: /* Methods: */
     Process & operator=(Process const &) noexcept = delete;
 
     void run();
+
+    /**
+      \brief Like run(), but with a bounded amount of fuel.
+      \details One unit of fuel is used by every backward jump, call and
+               system call, i.e. at each preemption point. When the fuel runs
+               out, the process traps with FuelExhaustedException and can be
+               resumed with resume() or resumeFor().
+      \param[in] fuel The amount of fuel, must be positive.
+    */
+    void runFor(std::uint64_t const fuel);
+
     void resume();
+
+    /** \brief Like resume(), but with a bounded amount of fuel, see runFor().*/
+    void resumeFor(std::uint64_t const fuel);
+
+    /**
+      \brief Like runFor(), but reports traps, exhausted fuel and suspended
+             system calls via the return value instead of exceptions.
+      \details This is the cheaper way to repeatedly run processes in small
+               time slices, since only errors are reported via exceptions.
+      \throws NotInInitializedStateException if the process is not in
+              initialized state.
+    */
+    ExecutionResult tryRun(std::uint64_t const fuel = unlimitedFuel);
+
+    /**
+      \brief Like resumeFor(), but reports traps, exhausted fuel and suspended
+             system calls via the return value instead of exceptions.
+      \throws NotInTrappedStateException if the process is not in trapped
+              state.
+    */
+    ExecutionResult tryResume(std::uint64_t const fuel = unlimitedFuel);
+
+    /**
+      \brief Calls a function of a finished process, keeping it resident.
+      \details After a process has been run to completion, e.g. to initialize
+               it, the functions of its code can be called repeatedly. Global
+               variables, public memory and process facilities persist between
+               the calls. The function at the given code offset is called with
+               the given arguments on its stack and without any references,
+               and the process halts when the function returns. Hence the
+               process is afterwards again finished, with the return value of
+               the function as its return value.
+      \param[in] codeOffset The code offset of the function in the current
+                            code section.
+      \param[in] arguments The arguments to the function.
+      \returns the return value of the function.
+      \throws NotInFinishedStateException if the process is not in finished
+              state.
+      \throws JumpToInvalidAddressException if there is no instruction at
+              the given code offset.
+    */
+    SharemindCodeBlock call(std::size_t const codeOffset,
+                            std::vector<SharemindCodeBlock> arguments);
+
+    /**
+      \brief Like call(), but with a bounded amount of fuel and reporting
+             traps, exhausted fuel and suspended system calls via the return
+             value, see tryRun().
+      \details When a call does not finish, the process can be resumed with
+               resume() or tryResume(), after which returnValue() gives the
+               return value of the function.
+    */
+    ExecutionResult tryCall(std::size_t const codeOffset,
+                            std::vector<SharemindCodeBlock> arguments,
+                            std::uint64_t const fuel = unlimitedFuel);
+
+    /**
+      \brief Attaches a named input buffer to the process.
+      \details The buffer is exposed to the bytecode as read-only public
+               memory without copying it. The bytecode gets the public memory
+               pointer of the input from the "Process_getInput" system call,
+               which takes the name as a constant reference and returns 0 if
+               there is no such input. An input with the same name is
+               replaced. The size of the buffer counts towards the public heap
+               usage of the process, but is not subject to its limits.
+      \param[in] name The name of the input.
+      \param[in] data The buffer, which must not be modified while attached.
+      \param[in] size The size of the buffer in bytes.
+      \throws NotInInitializedOrFinishedStateException if the process is
+              neither in initialized nor in finished state.
+    */
+    void setInput(std::string name,
+                  std::shared_ptr<void const> data,
+                  std::size_t const size);
+
+    /**
+      \brief Returns the named output buffer of the process.
+      \details The bytecode sets the output via the "Process_setOutput"
+               system call, which takes the name as a constant reference and
+               the public memory pointer of the output as an argument. The
+               memory is not copied and stays valid even after the bytecode
+               frees it. Must not be called while the process is running.
+      \returns a reference to the output, or a reference without data if no
+               such output has been set.
+    */
+    Vm::ConstReference output(std::string const & name) const;
+
+    /**
+      \brief Passes public memory of this process to another process without
+             copying it.
+      \details Intended for pipelines of processes, where one process
+               produces data for the next one. The memory usage moves with the
+               memory in TransferMode::Move, and is subject to the limits of
+               the target process. Shared memory counts towards the public
+               heap usage of both processes, but is not subject to the limits
+               of the target process, like inputs set via setInput(). Neither
+               process may be running while the memory is transferred.
+      \param[in] ptr The public memory pointer of the memory in this process.
+      \param[in] target The process to pass the memory to.
+      \param[in] mode Whether to move or to share the memory.
+      \returns the public memory pointer of the memory in the target process,
+               or 0 if the memory limits of the target process would be
+               exceeded.
+      \throws NotInInitializedTrappedOrFinishedStateException if either
+              process is neither in initialized, trapped nor finished state.
+      \throws InvalidMemoryHandleException if there is no memory at the given
+              pointer, other than a data section.
+      \throws MemoryInUseException if writable memory is referenced by this
+              process, e.g. from its stack or as an output.
+      \throws InvalidArgumentException if the target process is this process.
+    */
+    std::uint64_t transferMemory(std::uint64_t const ptr,
+                                 Process & target,
+                                 TransferMode const mode = TransferMode::Move);
+
+    /**
+      \brief Requests the running process to trap at its next preemption
+             point, see runFor().
+    */
     void pause() noexcept;
 
+    /**
+      \brief Creates an independent copy of this process.
+      \details The copy has the same stack frames, memory contents, memory
+               usage statistics, FPU state and facility finder as this process.
+               Read-only memory is shared between the processes, writable
+               memory is copied. Memory allocated privately by system calls is
+               not copied. If this process is trapped, the copy is also trapped
+               and can be resumed independently of this process.
+      \throws NotInInitializedOrTrappedStateException if this process is
+              neither in initialized nor in trapped state.
+    */
+    Process clone() const;
+
+    /**
+      \brief Writes a checkpoint of this process to the given stream.
+      \details The checkpoint contains the stack frames, public memory, inputs,
+               outputs, memory usage statistics and FPU state of the process,
+               from which restore() creates an equivalent process, e.g. after
+               the process has been evicted from memory or on another worker
+               running the same build of the VM. Like with clone(), memory
+               allocated privately by system calls is not saved. Neither are
+               the facility finder, the wakeup callback nor the system call
+               exception of the process. Shared segments of the program mapped
+               by the process are saved by name only and mapped again from the
+               program on restore.
+
+               An incremental checkpoint only contains the memory slots whose
+               contents have changed since the previous checkpoint of this
+               process, and can only be restored on top of a process restored
+               from that previous checkpoint. Without a previous checkpoint, a
+               full checkpoint is written.
+      \param[in] os The stream to write to.
+      \param[in] incremental Whether to write an incremental checkpoint.
+      \throws NotInInitializedOrTrappedStateException if this process is
+              neither in initialized nor in trapped state.
+      \throws UncheckpointableStateException if the process has references to
+              memory which is not part of the process, e.g. to memory it has
+              already freed, or if the asynchronous system call it is trapped
+              on failed and the error has not yet been thrown by resume().
+      \throws CheckpointIoException on output errors.
+    */
+    void checkpoint(std::ostream & os, bool const incremental = false);
+
+    /**
+      \brief Creates a process from a full checkpoint written by checkpoint().
+      \param[in] program The program the checkpointed process was running.
+      \param[in] is The stream to read the checkpoint from.
+      \returns a process in the state the checkpointed process was in.
+      \throws InvalidCheckpointException if the checkpoint is malformed or
+              was written by a process of a different program.
+      \throws CheckpointBaseMismatchException if the checkpoint is
+              incremental.
+      \throws CheckpointSharedSegmentMismatchException if a shared segment
+              mapped by the checkpointed process is missing from the program
+              or has a different size.
+      \throws CheckpointMemoryLimitException if the memory of the checkpointed
+              process exceeds the memory limits of the restored process.
+    */
+    static Process restore(Program & program, std::istream & is);
+
+    /**
+      \brief Creates a process from an incremental checkpoint.
+      \param[in] program The program the checkpointed process was running.
+      \param[in] is The stream to read the checkpoint from.
+      \param[in] base The process restored from or checkpointed to the
+                      checkpoint preceding the given one. The unchanged memory
+                      is copied from this process, which must not be running.
+      \returns a process in the state the checkpointed process was in.
+      \throws InvalidCheckpointException if the checkpoint is malformed or
+              was written by a process of a different program.
+      \throws CheckpointBaseMismatchException if the checkpoint is not based
+              on the last checkpoint of the given process.
+      \throws CheckpointSharedSegmentMismatchException if a shared segment
+              mapped by the checkpointed process is missing from the program
+              or has a different size.
+      \throws CheckpointMemoryLimitException if the memory of the checkpointed
+              process exceeds the memory limits of the restored process.
+    */
+    static Process restore(Program & program,
+                           std::istream & is,
+                           Process const & base);
+
+    /**
+      \brief Returns a finished or crashed process to the initialized state.
+      \details The writable data sections are restored to their initial
+               contents and all stack frames, public and private memory
+               allocations, memory statistics and the FPU state are reset. A
+               cancellation by a ProcessGroup is cleared, whereas holds by
+               paused groups persist. The storage of the process is reused
+               where possible.
+      \throws NotInFinishedOrCrashedStateException if the process is neither
+              in finished nor in crashed state.
+    */
+    void reset();
+
+    /**
+      \brief Sets the callback to call when a system call of this process which
+             was suspended via Vm::SyscallContext::suspend() is completed.
+      \details When run() or resume() throw SyscallPendingException, or when
+               tryRun() or tryResume() return ExecutionResult::Suspended, the
+               process can be resumed via resume() after this callback has been
+               called. The callback may be called from any thread, including
+               the one running the process before it returns. It must not
+               throw.
+    */
+    void setWakeupCallback(std::function<void ()> callback);
+
+    /**
+      \returns the instructions executed by this process so far, or empty
+               counts if its program was loaded with opcode counting disabled.
+      \note Must not be called while the process is running.
+      \see Vm::setOpcodeCountingEnabled()
+    */
+    Vm::OpcodeCounts opcodeCounts() const;
+
+    /**
+      \returns the statistics of the system calls made by this process so far,
+               or empty statistics if its program was loaded with system call
+               statistics disabled.
+      \note The latency of a suspended system call only covers the call
+            itself, not the time until it is completed.
+      \note Must not be called while the process is running.
+      \see Vm::setSyscallStatisticsEnabled()
+    */
+    Vm::SyscallStatisticsMap syscallStatistics() const;
+
     SharemindCodeBlock returnValue() const noexcept;
     std::exception_ptr syscallException() const noexcept;
     std::size_t currentCodeSectionIndex() const noexcept;
@@ -221,6 +561,10 @@ public: /* Methods: */
 
     std::shared_ptr<void> findFacility(char const * name) const noexcept;
 
+private: /* Methods: */
+
+    Process(std::shared_ptr<Inner> inner) noexcept;
+
 private: /* Fields: */
 
     std::shared_ptr<Inner> m_inner;
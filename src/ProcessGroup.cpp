@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#include "ProcessGroup.h"
+
+#include <cassert>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "Process_p.h"
+
+
+namespace sharemind {
+
+struct __attribute__((visibility("internal"))) ProcessGroup::Inner final {
+
+/* Types: */
+
+    using Processes = std::vector<std::shared_ptr<Process::Inner> >;
+
+/* Methods: */
+
+    /** \returns a snapshot of the processes, to act on without locking. */
+    Processes processes() const {
+        std::lock_guard<std::mutex> const guard(m_mutex);
+        return m_processes;
+    }
+
+/* Fields: */
+
+    mutable std::mutex m_mutex;
+    Processes m_processes;
+    bool m_paused = false;
+    bool m_cancelled = false;
+
+};
+
+ProcessGroup::ProcessGroup() : m_inner(std::make_shared<Inner>()) {}
+
+ProcessGroup::~ProcessGroup() noexcept {}
+
+void ProcessGroup::add(Process const & process) {
+    assert(process.m_inner);
+    std::lock_guard<std::mutex> const guard(m_inner->m_mutex);
+    m_inner->m_processes.emplace_back(process.m_inner);
+    /* Balance the release() of every process in resume(): */
+    if (m_inner->m_paused)
+        process.m_inner->hold();
+    if (m_inner->m_cancelled)
+        process.m_inner->cancel();
+}
+
+std::size_t ProcessGroup::size() const noexcept {
+    std::lock_guard<std::mutex> const guard(m_inner->m_mutex);
+    return m_inner->m_processes.size();
+}
+
+void ProcessGroup::pause() noexcept {
+    std::lock_guard<std::mutex> const guard(m_inner->m_mutex);
+    if (m_inner->m_paused)
+        return;
+    m_inner->m_paused = true;
+    for (auto const & process : m_inner->m_processes)
+        process->hold();
+}
+
+void ProcessGroup::resume() noexcept {
+    std::lock_guard<std::mutex> const guard(m_inner->m_mutex);
+    if (!m_inner->m_paused)
+        return;
+    m_inner->m_paused = false;
+    for (auto const & process : m_inner->m_processes)
+        process->release();
+}
+
+void ProcessGroup::cancel() noexcept {
+    std::lock_guard<std::mutex> const guard(m_inner->m_mutex);
+    m_inner->m_cancelled = true;
+    for (auto const & process : m_inner->m_processes)
+        process->cancel();
+}
+
+void ProcessGroup::wait() const {
+    for (auto const & process : m_inner->processes())
+        process->waitUntilStopped();
+}
+
+bool ProcessGroup::waitFor(std::chrono::nanoseconds const timeout) const {
+    auto const deadline =
+            std::chrono::steady_clock::now()
+            + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                  timeout);
+    for (auto const & process : m_inner->processes())
+        if (!process->waitUntilStopped(deadline))
+            return false;
+    return true;
+}
+
+} /* namespace sharemind { */
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+#ifndef SHAREMIND_LIBVM_PROCESSGROUP_H
+#define SHAREMIND_LIBVM_PROCESSGROUP_H
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include "Process.h"
+
+
+namespace sharemind {
+
+/**
+  \brief Controls many processes at once, e.g. all processes of a query.
+  \details Pausing, resuming and cancelling the group only sets or clears an
+           attention bit of each process, which the processes act upon at
+           their next preemption point (see Process::runFor()). Hence these
+           operations do not block and are cheap even for large groups. Use
+           wait() to wait until the processes have actually stopped. Waiting
+           does not poll, but blocks until notified by the processes.
+           The group keeps the states of its processes alive, but otherwise
+           the processes are run and resumed by their owners as usual, e.g.
+           by a Scheduler.
+*/
+class ProcessGroup {
+
+private: /* Types: */
+
+    struct Inner;
+
+public: /* Methods: */
+
+    ProcessGroup();
+
+    /**
+      \note The ProcessGroup object which will be moved from will be left in
+            an invalid state in which operations other than move-assignment
+            and destruction result in undefined behavior.
+    */
+    ProcessGroup(ProcessGroup &&) noexcept = default;
+    ProcessGroup(ProcessGroup const &) noexcept = delete;
+
+    /** \note Does not resume the processes of a paused group. */
+    virtual ~ProcessGroup() noexcept;
+
+    ProcessGroup & operator=(ProcessGroup &&) noexcept = default;
+    ProcessGroup & operator=(ProcessGroup const &) noexcept = delete;
+
+    /**
+      \brief Adds the given process to this group.
+      \details If the group is paused or cancelled, so is the process.
+      \param[in] process The process, which remains usable by the caller.
+    */
+    void add(Process const & process);
+
+    /** \returns the number of processes in this group. */
+    std::size_t size() const noexcept;
+
+    /**
+      \brief Holds all processes of this group.
+      \details Running processes trap at their next preemption point, after
+               which they are in trapped state and running or resuming them
+               returns Process::ExecutionResult::Held until the group is
+               resumed. Suspended system calls are not interrupted, but the
+               processes are held once resumed. Processes in several paused
+               groups are held until all of these groups are resumed. Pausing
+               a paused group has no effect.
+    */
+    void pause() noexcept;
+
+    /**
+      \brief Undoes pause().
+      \details The wakeup callbacks of the processes which have returned
+               Process::ExecutionResult::Held are called, so that their
+               owners (e.g. a Scheduler) can resume them.
+      \note The wakeup callbacks are called with this group locked, hence
+            they must not use this group.
+    */
+    void resume() noexcept;
+
+    /**
+      \brief Cancels all processes of this group.
+      \details Running processes crash with Process::CancelledException at
+               their next preemption point, other processes when they are
+               next run or resumed. Held processes are woken up like by
+               resume(), so that their owners can run them to the crash.
+               Process::reset() clears the cancellation of a process, so
+               that it can be reused, but processes added to a cancelled
+               group are cancelled again.
+    */
+    void cancel() noexcept;
+
+    /** \brief Waits until none of the processes of this group are running. */
+    void wait() const;
+
+    /**
+      \brief Waits until none of the processes of this group are running, or
+             until the timeout expires.
+      \returns false if the timeout expired first.
+    */
+    bool waitFor(std::chrono::nanoseconds const timeout) const;
+
+private: /* Fields: */
+
+    std::shared_ptr<Inner> m_inner;
+
+}; /* class ProcessGroup */
+
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_LIBVM_PROCESSGROUP_H */
@@ -28,22 +28,34 @@
 
 #include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iosfwd>
 #include <limits>
 #include <list>
 #include <mutex>
 #include <sharemind/libsoftfloat/softfloat.h>
 #include <sharemind/likely.h>
+#include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
+#include "CacheLine.h"
 #include "Core.h"
 #include "MemoryMap.h"
 #include "Program_p.h"
+#include "Sha256.h"
 #include "StackFrame.h"
 
 
 namespace sharemind {
 namespace Detail {
 
+class ProfilerState;
+
 struct __attribute__((visibility("internal"))) MemoryInfo final {
     std::size_t usage = 0u;
     std::size_t max = 0u;
@@ -60,13 +72,47 @@ public: /* Methods: */
 
     std::size_t free(void * const ptr) noexcept;
 
+    /** \brief Frees all allocations. */
+    void clear() noexcept;
+
+private: /* Types: */
+
+    using Allocations = std::unordered_map<void *, std::size_t>;
+
 private: /* Fields: */
 
-    std::unordered_map<void *, std::size_t> m_data;
+    /** Allocated on first use, since most processes never use it. */
+    std::unique_ptr<Allocations> m_data;
+
+};
+
+/**
+  \brief Memoized process facility lookups of a single process.
+  \details Only accessed by the thread executing the process, hence requires
+           no locking. Processes typically use only a handful of facilities, so
+           a linear search is used.
+*/
+struct __attribute__((visibility("internal"))) FacilityMemo final {
+
+/* Types: */
+
+    struct Entry {
+        std::string name;
+        std::shared_ptr<void> facility;
+    };
+
+/* Fields: */
+
+    std::vector<Entry> entries;
+    std::uint64_t vmGeneration = 0u;
+    std::uint64_t programGeneration = 0u;
+    std::uint64_t processGeneration = 0u;
 
 };
 
-struct __attribute__((visibility("internal"))) ProcessState {
+struct __attribute__((visibility("internal"))) ProcessState
+    : std::enable_shared_from_this<ProcessState>
+{
 
 /* Types: */
 
@@ -78,13 +124,83 @@ struct __attribute__((visibility("internal"))) ProcessState {
 
     enum class State {
         Initialized,
-        Starting,
         Running,
         Trapped,
+        Suspended,
         Finished,
         Crashed
     };
 
+    struct Input {
+        std::uint64_t ptr;
+        MemoryMap::ValueType slot;
+    };
+
+    struct IoBuffers {
+
+    /* Fields: */
+
+        /**
+          \brief The named inputs attached by the host.
+          \details The slots are kept to detect whether the bytecode has freed
+                   the memory of an input, after which its pointer may be
+                   reused.
+        */
+        std::unordered_map<std::string, Input> inputs;
+        /** The named outputs set by the bytecode, kept until replaced. */
+        std::unordered_map<std::string, MemoryMap::ValueType> outputs;
+        /** The shared segments of the program mapped by the bytecode. */
+        std::unordered_map<std::string, Input> sharedSegments;
+
+    };
+
+    /** The identity of the last checkpoint, see Process::checkpoint(). */
+    struct CheckpointState {
+
+    /* Fields: */
+
+        std::uint64_t id;
+        /** The hashes of the memory slots at the time of the checkpoint. */
+        std::unordered_map<std::uint64_t, Sha256::Digest> slotHashes;
+
+    };
+
+    /** The instruction counters, see Vm::setOpcodeCountingEnabled(). */
+    struct OpcodeCounters {
+
+    /* Constants: */
+
+        static constexpr std::uint32_t const noPrevious =
+                static_cast<std::uint32_t>(-1);
+
+    /* Methods: */
+
+        /** \param[in] numOpcodes See CodeSection::numCountedOpcodes(). */
+        OpcodeCounters(std::size_t const numOpcodes);
+
+    /* Fields: */
+
+        /** Indexed by CodeSection::countedOpcode(). */
+        std::vector<std::uint64_t> counts;
+        /**
+          \brief Indexed by the previous opcode index times the number of
+                 opcodes plus the current opcode index.
+          \details Allocated up front, so that counting does not allocate.
+        */
+        std::vector<std::uint64_t> pairCounts;
+        std::uint32_t previous = noPrevious;
+
+    };
+
+    /** Attention bit requesting the process to trap, set by pause(). */
+    static constexpr unsigned const AttentionPause = 1u;
+    /** Attention bit holding the process trapped, set while m_numHolds > 0. */
+    static constexpr unsigned const AttentionHold = 2u;
+    /** Attention bit requesting the process to crash, set by cancel(). */
+    static constexpr unsigned const AttentionCancel = 4u;
+    /** Attention bit requesting a profiler sample, set by requestSample(). */
+    static constexpr unsigned const AttentionSample = 8u;
+
     struct SyscallContext final: Vm::SyscallContext {
 
     /* Methods: */
@@ -93,7 +209,7 @@ struct __attribute__((visibility("internal"))) ProcessState {
 
         std::shared_ptr<void> processFacility(char const * facilityName)
                 const noexcept final override
-        { return m_state.findProcessFacility(facilityName); }
+        { return m_state.findProcessFacilityMemoized(facilityName); }
 
         /* Access to public dynamic memory inside the VM process: */
         PublicMemoryPointer publicAlloc(std::uint64_t nBytes) final override
@@ -114,6 +230,9 @@ struct __attribute__((visibility("internal"))) ProcessState {
         std::size_t currentInstructionIndex() const noexcept final override
         { return m_state.m_currentIp; }
 
+        Vm::PendingSyscall suspend() final override
+        { return m_state.suspendSyscall(); }
+
     /* Fields: */
 
         ProcessState & m_state;
@@ -122,7 +241,19 @@ struct __attribute__((visibility("internal"))) ProcessState {
 
 /* Methods: */
 
-    ProcessState(std::shared_ptr<PreparedExecutable const> preparedExecutable);
+    /**
+      \param[in] dataSectionBatch if not null, the batch to allocate the
+                                  writable data sections of the process from.
+    */
+    ProcessState(std::shared_ptr<ProgramState> programState,
+                 DataSectionBatch * dataSectionBatch = nullptr);
+
+    /**
+      \brief Clones the given process.
+      \pre The m_runStateMutex of the given process is locked and the process
+           is either in State::Initialized or in State::Trapped.
+    */
+    ProcessState(ProcessState const & copy);
 
     virtual ~ProcessState() noexcept;
 
@@ -132,15 +263,145 @@ struct __attribute__((visibility("internal"))) ProcessState {
 
     void setInternal(std::shared_ptr<void> value);
 
-    void run();
-    void resume();
-    void execute(ExecuteMethod const executeMethod);
+    Process::ExecutionResult run(std::uint64_t const fuel);
+    Process::ExecutionResult resume(std::uint64_t const fuel);
+    Process::ExecutionResult call(std::size_t const codeOffset,
+                                  StackFrame::RegisterVector arguments,
+                                  std::uint64_t const fuel);
+    Process::ExecutionResult execute(ExecuteMethod const executeMethod);
+
+    /**
+      \brief Changes the state from the expected one to State::Running under
+             m_runStateMutex, or calls the given function which must throw.
+    */
+    template <typename OnWrongState>
+    void startRunning(State const expected, OnWrongState && onWrongState);
     void pause() noexcept;
+    void reset();
+
+    /**
+      \brief Makes the process trap at its next preemption point and stay
+             trapped until release() is called.
+      \details Holds are counted, so that a process held e.g. by several
+               process groups stays held until all of them have released it.
+    */
+    void hold() noexcept;
+
+    /**
+      \brief Undoes one hold(), calling the wakeup callback if that was the
+             last hold and the process has stopped because it was held.
+      \pre The number of calls to hold() exceeds that to release().
+    */
+    void release() noexcept;
+
+    /**
+      \brief Makes the process crash with Process::CancelledException at its
+             next preemption point, or when it is next run or resumed.
+      \details The cancellation is cleared by reset(). Held processes are
+               woken up, so that they can be resumed to the crash.
+    */
+    void cancel() noexcept;
+
+    /**
+      \brief Makes the process record its instruction pointer and call stack
+             to its profiler at the next preemption point, without stopping.
+      \details Requests made before the process reaches a preemption point
+               are recorded as a single sample weighted by their number.
+    */
+    void requestSample() noexcept;
+
+    void setProfiler(std::shared_ptr<ProfilerState> profiler) noexcept;
+
+    /** \brief Unsets the profiler of the process if it is the given one. */
+    void detachProfiler(ProfilerState const * const profiler) noexcept;
+
+    /** \brief Waits until the process is not running. */
+    void waitUntilStopped() const;
+
+    /**
+      \brief Waits until the process is not running or the deadline is
+             reached.
+      \returns whether the process is not running.
+    */
+    bool waitUntilStopped(std::chrono::steady_clock::time_point const deadline)
+            const;
+
+    /** \brief Wakes the threads in waitUntilStopped() if there are any. */
+    void notifyStopped() noexcept;
+
+    /**
+      \brief Handles an exhausted fuel budget or pending attention bits.
+      \details Called by the interpreter at preemption points after the state
+               has been updated to the next instruction to execute.
+               Pending profiler samples are taken without stopping.
+      \returns VmRunResult::Cancelled if the process was cancelled,
+               VmRunResult::FuelExhausted if no fuel is left,
+               VmRunResult::Held if the process is held,
+               VmRunResult::Trapped if the process was paused, and
+               VmRunResult::Continue otherwise.
+    */
+    VmRunResult handleAttention() noexcept;
+
+    /**
+      \brief Records the current call stack to the profiler, if any.
+      \param[in] weight The number of sample requests the sample is for.
+    */
+    void takeSample(std::uint64_t const weight) noexcept;
+
+    Vm::PendingSyscall suspendSyscall();
+    void completeSyscall(Vm::PendingSyscall::Inner & pendingSyscall,
+                         SharemindCodeBlock const * returnValue,
+                         std::exception_ptr exception) noexcept;
+    void finishPendingSyscall() noexcept;
+    void abandonPendingSyscall() noexcept;
 
     std::uint64_t publicAlloc(std::uint64_t const size);
     MemoryMap::ErrorCode publicFree(std::uint64_t const ptr) noexcept;
     std::size_t publicSlotSize(std::uint64_t const ptr) const noexcept;
     void * publicSlotPtr(std::uint64_t const ptr) const noexcept;
+
+    void setInput(std::string name,
+                  std::shared_ptr<void const> data,
+                  std::size_t const size);
+    /** \returns the public memory pointer of the named input, or 0. */
+    std::uint64_t inputPtr(std::string const & name) const noexcept;
+    void setOutput(std::string name, std::uint64_t const ptr);
+    /**
+      \brief Maps the named shared segment of the program, if not yet mapped.
+      \returns the public memory pointer of the segment, or 0 if the program
+               has no such segment.
+    */
+    std::uint64_t sharedSegmentPtr(std::string const & name);
+    Vm::ConstReference output(std::string const & name) const;
+    IoBuffers & ioBuffers();
+
+    /** \brief Adds to the public heap usage without checking the limits. */
+    void addPublicMemoryUsage(std::size_t const size) noexcept;
+
+    /**
+      \brief Passes public memory to the target process, see
+             Process::transferMemory().
+      \pre The m_runStateMutex of both processes is locked and neither
+           process is running.
+    */
+    std::uint64_t transferMemory(std::uint64_t const ptr,
+                                 ProcessState & target,
+                                 Process::TransferMode const mode);
+
+    /**
+      \brief Writes a checkpoint of this process, see Process::checkpoint().
+      \pre The m_runStateMutex is locked and the process is either in
+           State::Initialized or in State::Trapped.
+    */
+    void writeCheckpoint(std::ostream & os, bool const incremental);
+
+    /**
+      \brief Restores this newly created process from a checkpoint, see
+             Process::restore().
+      \param[in] base The process to copy unchanged memory from, if any.
+    */
+    void readCheckpoint(std::istream & is, ProcessState const * base);
+
     void * privateAlloc(std::size_t const nBytes);
     void privateFree(void * const ptr);
     bool privateReserve(std::size_t const nBytes);
@@ -149,6 +410,34 @@ struct __attribute__((visibility("internal"))) ProcessState {
     inline CodeSection const & currentCodeSection() const noexcept
     { return m_preparedLinkingUnit->codeSection; }
 
+    /**
+      \brief Counts the execution of the instruction at the given offset.
+      \pre The code section counts opcodes.
+    */
+    void countOpcode(std::size_t const offset) noexcept;
+
+    Vm::OpcodeCounts opcodeCounts() const;
+
+    /**
+      \brief Records a call of the system call binding with the given index.
+      \pre The system call bindings are timed.
+    */
+    void recordSyscall(std::size_t const bindingIndex,
+                       std::chrono::nanoseconds const latency) noexcept;
+
+    /**
+      \brief Defers recording the current system call until it completes, if
+             it was suspended.
+      \param[in] bindingIndex The index of the binding of the system call.
+      \param[in] start When the system call was started.
+      \returns whether the system call was suspended.
+    */
+    bool deferSyscallTiming(
+            std::size_t const bindingIndex,
+            std::chrono::steady_clock::time_point const start) noexcept;
+
+    Vm::SyscallStatisticsMap syscallStatistics() const;
+
     template <typename F, typename ... Args>
     auto runStatefulSoftfloatOperation(F f, Args && ... args)
             -> decltype(
@@ -182,64 +471,187 @@ struct __attribute__((visibility("internal"))) ProcessState {
 
     std::shared_ptr<void> findProcessFacility(char const * name) const noexcept;
 
+    /**
+      \brief Like findProcessFacility(), but memoizes successful lookups.
+      \details Memoized lookups only compare the finder generations, without
+               locking. Only misses lock the finders to call them.
+      \warning May only be called by the thread executing the process.
+    */
+    std::shared_ptr<void> findProcessFacilityMemoized(char const * name)
+            noexcept;
+
+    void setProcessFacilityFinder(Vm::FacilityFinderFunPtr f) noexcept;
+    Vm::FacilityFinderFunPtr processFacilityFinder() const noexcept;
+
 /* Fields: */
 
-    Vm::FacilityFinderFunPtr m_processFacilityFinder;
-    std::shared_ptr<ProgramState> m_programState;
+    /*
+      The fields are grouped by the threads accessing them. The blocks are not
+      padded to cache lines, since that would grow every process for a gain
+      not yet measured. bench/ProcessLayout.cpp measures how much other
+      threads accessing a process slow it down.
+    */
 
-    mutable std::mutex m_mutex;
+    /* Set on construction and only read afterwards: */
 
+    std::shared_ptr<ProgramState> m_programState;
     std::size_t m_activeLinkingUnitIndex;
     /// Keeps alive read-only data and code:
     std::shared_ptr<PreparedLinkingUnit const> m_preparedLinkingUnit;
 
+    /* The hot interpreter state, accessed only by the thread running it: */
+
     std::size_t m_currentIp = 0u;
-    SharemindCodeBlock m_returnValue;
-    Process::UserDefinedException m_userException;
-    std::exception_ptr m_syscallException;
+    /** Preemption fuel left, see Process::runFor(). */
+    std::uint64_t m_fuel = Process::unlimitedFuel;
 
-    std::atomic<bool> m_trapCond{false};
+    std::list<StackFrame> m_frames;
+    StackFrame * m_globalFrame{
+            (static_cast<void>(m_frames.emplace_back()),
+             /* Triggers halt on return: */
+             static_cast<void>(m_frames.back().returnAddr = nullptr),
+             &m_frames.back())};
+    StackFrame * m_nextFrame = nullptr;
+    StackFrame * m_thisFrame = m_globalFrame;
 
     // This state replicates default AMD64 behaviour.
     // NB! By default, we ignore any FPU exceptions.
-    sf_fpu_state m_fpuState =
+    static constexpr sf_fpu_state const initialFpuState =
             static_cast<sf_fpu_state>(sf_float_tininess_after_rounding
                                       | sf_float_round_nearest_even);
+    sf_fpu_state m_fpuState = initialFpuState;
+    SharemindCodeBlock m_returnValue;
 
     SimpleMemoryMap m_memoryMap;
-    std::uint64_t m_memorySlotNext;
     PrivateMemoryMap m_privateMemoryMap;
 
     SyscallContext m_syscallContext{*this};
+    FacilityMemo m_facilityMemo;
+    std::exception_ptr m_syscallException;
+    /** Set only if the code section counts opcodes. */
+    std::unique_ptr<OpcodeCounters> m_opcodeCounters;
+    /** By binding index, set only if the system call bindings are timed. */
+    std::unique_ptr<std::vector<Vm::SyscallStatistics> > m_syscallStatistics;
+
+    /**
+      \brief Attention bits (e.g. AttentionPause) set by other threads.
+      \details Polled by the interpreter at every preemption point.
+    */
+    std::atomic<unsigned> m_attention{0u};
+    /**
+      \brief The number of profiler samples requested since the last sample
+             was taken, see requestSample().
+      \details Next to m_attention, since both are written by the sampler
+               thread.
+    */
+    std::atomic<std::uint64_t> m_pendingSamples{0u};
+
+    /* The control state, accessed by other threads: */
+
+    mutable std::mutex m_runStateMutex;
+    /**
+      \brief The run state of the process.
+      \details Transitions to State::Running and to and from
+               State::Suspended happen under m_runStateMutex, other transitions
+               from State::Running happen without locking by the thread running
+               the process. Hence operations which must not overlap with
+               running the process (e.g. reset() or Process::clone()) check
+               the state and do their work under m_runStateMutex.
+    */
+    std::atomic<State> m_state{State::Initialized};
+
+    /**
+      \brief The suspended system call, if any.
+      \details Set by suspendSyscall() while running, otherwise guarded by
+               m_runStateMutex. While set, the frame of the system call (the
+               last one in m_frames) is kept.
+    */
+    std::shared_ptr<Vm::PendingSyscall::Inner> m_pendingSyscall;
+    SharemindCodeBlock * m_pendingSyscallReturnValueAddr = nullptr;
+    /** The error of the last asynchronous system call, to throw on resume. */
+    std::exception_ptr m_pendingSyscallException;
+    /* Guarded by m_runStateMutex: */
+    std::function<void ()> m_wakeupCallback;
+    /** The number of holds not yet released, see hold(). */
+    unsigned m_numHolds = 0u;
+    /** Whether the process stopped because it was held, see hold(). */
+    bool m_stoppedByHold = false;
+
+    /** Signalled with m_runStateMutex when the process stops running. */
+    mutable std::condition_variable m_stoppedCondition;
+    /** The number of threads waiting on m_stoppedCondition. */
+    mutable std::atomic<unsigned> m_numStoppedWaiters{0u};
+
+    mutable std::mutex m_facilityFinderMutex;
+    /** Guarded by m_facilityFinderMutex. */
+    Vm::FacilityFinderFunPtr m_processFacilityFinder;
+    std::atomic<std::uint64_t> m_facilityFinderGeneration{0u};
+
+    /** Accessed only with std::atomic_load and std::atomic_store. */
+    std::shared_ptr<ProfilerState> m_profiler;
+
+    /* Cold bookkeeping, which monitoring threads may also read: */
 
     MemoryInfo m_memPublicHeap;
     MemoryInfo m_memPrivate;
     MemoryInfo m_memReserved;
     MemoryInfo m_memTotal;
 
-    std::list<StackFrame> m_frames;
-    StackFrame * m_globalFrame{
-            (static_cast<void>(m_frames.emplace_back()),
-             /* Triggers halt on return: */
-             static_cast<void>(m_frames.back().returnAddr = nullptr),
-             &m_frames.back())};
-    StackFrame * m_nextFrame = nullptr;
-    StackFrame * m_thisFrame = m_globalFrame;
-
-    mutable std::mutex m_runStateMutex;
-    State m_state = State::Initialized;
+    /** Allocated on first use, since most processes have no buffers. */
+    std::unique_ptr<IoBuffers> m_ioBuffers;
+    /** Set by the last checkpoint of or restore to this process, if any. */
+    std::unique_ptr<CheckpointState> m_checkpointState;
 
 }; /* class ProcessState */
 } /* namespace Detail { */
 
 
+struct __attribute__((visibility("internal"))) Vm::PendingSyscall::Inner final
+{
+
+/* Constants: */
+
+    static constexpr std::size_t const notTimed =
+            std::numeric_limits<std::size_t>::max();
+
+/* Methods: */
+
+    Inner(std::shared_ptr<Detail::ProcessState> process_) noexcept
+        : process(std::move(process_))
+    {}
+
+/* Fields: */
+
+    std::weak_ptr<Detail::ProcessState> const process;
+
+    /* Guarded by the m_runStateMutex of the process: */
+    bool completed = false;
+    bool hasReturnValue = false;
+    SharemindCodeBlock returnValue;
+    std::exception_ptr exception;
+    /** When completed, only set if the system call bindings are timed. */
+    std::chrono::steady_clock::time_point completionTime;
+
+    /**
+      \brief The timed binding of the system call, if any.
+      \details Set by the process after the system call returns, only read
+               once the call is finished.
+    */
+    std::size_t timedBindingIndex = notTimed;
+    std::chrono::steady_clock::time_point startTime;
+
+};
+
+
 struct __attribute__((visibility("internal"))) Process::Inner final
     : Detail::ProcessState
 {
 
 /* Methods: */
 
-    Inner(std::shared_ptr<Program::Inner> programInner);
+    Inner(std::shared_ptr<Program::Inner> programInner,
+          Detail::DataSectionBatch * dataSectionBatch = nullptr);
+    Inner(Inner const & copy);
     ~Inner() noexcept;
 
 };
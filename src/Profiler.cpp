@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#include "Profiler.h"
+#include "Profiler_p.h"
+
+#include <algorithm>
+#include <cassert>
+#include <ostream>
+#include "Process_p.h"
+
+
+namespace sharemind {
+namespace Detail {
+
+ProfilerState::ProfilerState(std::chrono::nanoseconds interval)
+    : m_interval(std::max(interval,
+                          std::chrono::nanoseconds(
+                              std::chrono::microseconds(1))))
+    , m_samplerThread(&ProfilerState::samplerLoop, this)
+{}
+
+ProfilerState::~ProfilerState() noexcept { stop(); }
+
+void ProfilerState::add(std::shared_ptr<ProcessState> const & process) {
+    assert(process);
+    /*
+      Set first, lest requestSamples() drop the process as profiled by another
+      profiler:
+    */
+    process->setProfiler(shared_from_this());
+    {
+        std::lock_guard<std::mutex> const guard(m_processesMutex);
+        /* Each process is sampled at most once per interval: */
+        std::weak_ptr<ProcessState> const weakProcess(process);
+        if (std::none_of(m_processes.begin(),
+                         m_processes.end(),
+                         [&weakProcess](
+                                 std::weak_ptr<ProcessState> const & p)
+                                 noexcept
+                         {
+                             return !p.owner_before(weakProcess)
+                                    && !weakProcess.owner_before(p);
+                         }))
+            m_processes.emplace_back(weakProcess);
+    }
+}
+
+void ProfilerState::addSample(
+        std::shared_ptr<PreparedLinkingUnit const> linkingUnit,
+        std::vector<std::size_t> stack,
+        std::uint64_t const weight)
+{
+    assert(linkingUnit);
+    assert(weight);
+    std::lock_guard<std::mutex> const guard(m_samplesMutex);
+    auto const * const key = linkingUnit.get();
+    m_linkingUnits.emplace(key, std::move(linkingUnit));
+    m_samples[Stack(key, std::move(stack))] += weight;
+    m_numSamples += weight;
+}
+
+std::uint64_t ProfilerState::numSamples() const noexcept {
+    std::lock_guard<std::mutex> const guard(m_samplesMutex);
+    return m_numSamples;
+}
+
+void ProfilerState::clear() noexcept {
+    std::lock_guard<std::mutex> const guard(m_samplesMutex);
+    m_samples.clear();
+    m_linkingUnits.clear();
+    m_numSamples = 0u;
+}
+
+void ProfilerState::writeCollapsedStacks(std::ostream & os) const {
+    std::lock_guard<std::mutex> const guard(m_samplesMutex);
+    for (auto const & sample : m_samples) {
+        auto const & codeSection = sample.first.first->codeSection;
+        auto const & offsets = sample.first.second;
+        assert(!offsets.empty());
+        for (std::size_t i = 0u; i < offsets.size(); ++i) {
+            auto index = codeSection.instructionIndexAtOffset(offsets[i]);
+            if (i + 1u < offsets.size()) {
+                /* Return addresses follow their call instructions: */
+                assert(index > 0u);
+                --index;
+            }
+            if (i > 0u)
+                os << ';';
+            auto const * const info =
+                    codeSection.instructionDescriptionAtOffset(index);
+            os << (info ? info->fullName : "eof") << '@' << index;
+        }
+        os << ' ' << sample.second << '\n';
+    }
+}
+
+void ProfilerState::stop() noexcept {
+    {
+        std::lock_guard<std::mutex> const guard(m_stopMutex);
+        m_stop = true;
+    }
+    m_stopCondition.notify_all();
+    if (m_samplerThread.joinable())
+        m_samplerThread.join();
+
+    std::lock_guard<std::mutex> const guard(m_processesMutex);
+    for (auto const & weakProcess : m_processes)
+        if (auto const process = weakProcess.lock())
+            process->detachProfiler(this);
+    m_processes.clear();
+}
+
+void ProfilerState::samplerLoop() noexcept {
+    std::unique_lock<std::mutex> lock(m_stopMutex);
+    while (!m_stopCondition.wait_for(lock,
+                                     m_interval,
+                                     [this]() noexcept { return m_stop; }))
+    {
+        lock.unlock();
+        requestSamples();
+        lock.lock();
+    }
+}
+
+void ProfilerState::requestSamples() noexcept {
+    std::lock_guard<std::mutex> const guard(m_processesMutex);
+    m_processes.erase(
+                std::remove_if(
+                    m_processes.begin(),
+                    m_processes.end(),
+                    [this](std::weak_ptr<ProcessState> const & weakProcess)
+                            noexcept
+                    {
+                        auto const process(weakProcess.lock());
+                        if (!process)
+                            return true;
+                        /* Drop processes since added to another profiler: */
+                        if (std::atomic_load(&process->m_profiler).get()
+                            != this)
+                            return true;
+                        /* Only running processes are sampled: */
+                        if (process->m_state.load(std::memory_order_relaxed)
+                            == ProcessState::State::Running)
+                            process->requestSample();
+                        return false;
+                    }),
+                m_processes.end());
+}
+
+} // namespace Detail {
+
+
+Profiler::Profiler(std::chrono::nanoseconds interval)
+    : m_inner(std::make_shared<Inner>(interval))
+{}
+
+Profiler::~Profiler() noexcept { m_inner->stop(); }
+
+void Profiler::add(Process const & process) {
+    assert(process.m_inner);
+    m_inner->add(process.m_inner);
+}
+
+std::uint64_t Profiler::numSamples() const noexcept
+{ return m_inner->numSamples(); }
+
+void Profiler::clear() noexcept { m_inner->clear(); }
+
+void Profiler::writeCollapsedStacks(std::ostream & os) const
+{ m_inner->writeCollapsedStacks(os); }
+
+} /* namespace sharemind { */
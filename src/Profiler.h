@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+#ifndef SHAREMIND_LIBVM_PROFILER_H
+#define SHAREMIND_LIBVM_PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include "Process.h"
+
+
+namespace sharemind {
+
+/**
+  \brief A sampling profiler for the bytecode of running processes.
+  \details A sampler thread periodically sets an attention bit of each running
+           process added to the profiler. The process records its instruction
+           pointer and call stack at its next preemption point (see
+           Process::runFor()) and continues without stopping. The instruction
+           pointer is only published to the sampler on this slow path, hence
+           processes pay nothing for profiling between samples.
+  \note Since samples are taken at preemption points, i.e. at backward jumps,
+        calls and system calls, time spent in straight-line code is attributed
+        to the next preemption point. If a process takes several sampling
+        intervals to reach it, the sample counts once per interval.
+*/
+class Profiler {
+
+private: /* Types: */
+
+    struct Inner;
+
+public: /* Methods: */
+
+    /**
+      \brief Starts the sampler thread.
+      \param[in] interval The time between samples of each running process,
+                          at least one microsecond.
+    */
+    Profiler(std::chrono::nanoseconds interval);
+
+    Profiler(Profiler &&) noexcept = delete;
+    Profiler(Profiler const &) noexcept = delete;
+
+    /** \brief Stops the sampler thread and detaches from all processes. */
+    virtual ~Profiler() noexcept;
+
+    Profiler & operator=(Profiler &&) noexcept = delete;
+    Profiler & operator=(Profiler const &) noexcept = delete;
+
+    /**
+      \brief Adds the given process to this profiler.
+      \details A process is profiled by at most one profiler at a time, adding
+               it to another profiler detaches it from this one. The profiler
+               does not keep the process alive.
+      \param[in] process The process, which remains usable by the caller.
+    */
+    void add(Process const & process);
+
+    /**
+      \returns the number of samples taken, weighted by the number of sampling
+               intervals each is for.
+    */
+    std::uint64_t numSamples() const noexcept;
+
+    /** \brief Discards all samples taken so far. */
+    void clear() noexcept;
+
+    /**
+      \brief Writes the samples in the collapsed stack format read by flame
+             graph tools.
+      \details Every line has the form "frame;frame;...;frame count", starting
+               from the outermost frame. The caller frames name their call
+               instruction and the innermost frame names the instruction to be
+               executed next, as "name@index", where index is the index of the
+               instruction in its code section (see Program::instruction()).
+    */
+    void writeCollapsedStacks(std::ostream & os) const;
+
+private: /* Fields: */
+
+    std::shared_ptr<Inner> m_inner;
+
+}; /* class Profiler */
+
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_LIBVM_PROFILER_H */
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+#ifndef SHAREMIND_LIBVM_PROFILER_P_H
+#define SHAREMIND_LIBVM_PROFILER_P_H
+
+#ifndef SHAREMIND_INTERNAL_
+#error including an internal header!
+#endif
+
+#include "Profiler.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace sharemind {
+namespace Detail {
+
+struct PreparedLinkingUnit;
+struct ProcessState;
+
+class __attribute__((visibility("internal"))) ProfilerState
+    : public std::enable_shared_from_this<ProfilerState>
+{
+
+private: /* Types: */
+
+    /** A linking unit and the code offsets of a call stack within it. */
+    using Stack = std::pair<PreparedLinkingUnit const *,
+                            std::vector<std::size_t> >;
+
+public: /* Methods: */
+
+    ProfilerState(std::chrono::nanoseconds interval);
+    ~ProfilerState() noexcept;
+
+    void add(std::shared_ptr<ProcessState> const & process);
+
+    /**
+      \brief Records a sample of a process.
+      \param[in] linkingUnit The linking unit being executed.
+      \param[in] stack The return addresses of the callers, followed by the
+                       current instruction pointer, as code offsets.
+      \param[in] weight The number of sampling intervals the sample is for.
+    */
+    void addSample(std::shared_ptr<PreparedLinkingUnit const> linkingUnit,
+                   std::vector<std::size_t> stack,
+                   std::uint64_t const weight);
+
+    std::uint64_t numSamples() const noexcept;
+    void clear() noexcept;
+    void writeCollapsedStacks(std::ostream & os) const;
+
+    /** \brief Stops the sampler thread and detaches from all processes. */
+    void stop() noexcept;
+
+private: /* Methods: */
+
+    void samplerLoop() noexcept;
+    void requestSamples() noexcept;
+
+private: /* Fields: */
+
+    std::chrono::nanoseconds const m_interval;
+
+    /* The samples, guarded by m_samplesMutex: */
+    mutable std::mutex m_samplesMutex;
+    std::map<Stack, std::uint64_t> m_samples;
+    /** Keeps alive the code sections of the samples. */
+    std::unordered_map<PreparedLinkingUnit const *,
+                       std::shared_ptr<PreparedLinkingUnit const> >
+            m_linkingUnits;
+    std::uint64_t m_numSamples = 0u;
+
+    /* The profiled processes, guarded by m_processesMutex: */
+    std::mutex m_processesMutex;
+    std::vector<std::weak_ptr<ProcessState> > m_processes;
+
+    std::mutex m_stopMutex;
+    std::condition_variable m_stopCondition;
+    bool m_stop = false;
+    std::thread m_samplerThread;
+
+}; /* class ProfilerState */
+
+} /* namespace Detail { */
+
+struct __attribute__((visibility("internal"))) Profiler::Inner final
+    : Detail::ProfilerState
+{ using Detail::ProfilerState::ProfilerState; };
+
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_LIBVM_PROFILER_P_H */
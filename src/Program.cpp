@@ -29,7 +29,6 @@
 #include <limits>
 #include <new>
 #include <sharemind/GlobalDeleter.h>
-#include <sharemind/InputMemoryStream.h>
 #include <sharemind/IntegralComparisons.h>
 #include <sharemind/libexecutable/Executable.h>
 #include <sharemind/libvmi/instr.h>
@@ -40,9 +39,14 @@
 #include <type_traits>
 #include <unistd.h>
 #include <utility>
+#include "BatchAllocator.h"
+#include "BuiltinSyscalls.h"
 #include "CommonInstructionMacros.h"
 #include "Core.h"
+#include "GzipExecutableReader.h"
+#include "InputMemory.h"
 #include "PreparationBlock.h"
+#include "Process_p.h"
 #include "Vm_p.h"
 
 
@@ -145,6 +149,83 @@ static struct preprocess_pass2_function preprocess_pass2_functions[] = {
     { 0u, nullptr }
 };
 
+/**
+  \brief An open-addressing hash table mapping instruction codes to both their
+         descriptions and their second pass preparation functions.
+
+  The table is built only once from the generated preparation functions list
+  and the instruction code map of LibVmi. It is at most half full and uses
+  Fibonacci hashing with linear probing, hence lookups are expected to touch
+  only a single cache line.
+*/
+class PreparationTable {
+
+public: /* Types: */
+
+    struct Entry {
+        std::uint64_t code;
+        VmInstructionInfo const * description;
+        void (*pass2)(Detail::PreparedSyscallBindings & syscallBindings,
+                      Detail::CodeSection & s,
+                      SharemindCodeBlock * c,
+                      std::size_t * i);
+    };
+
+public: /* Methods: */
+
+    PreparationTable() {
+        auto const & cm = instructionCodeMap();
+        std::size_t numEntries = 0u;
+        for (auto * ppf = &preprocess_pass2_functions[0]; ppf->f; ++ppf)
+            ++numEntries;
+
+        std::size_t capacity = 2u;
+        for (m_shift = 63u; capacity < numEntries * 2u; --m_shift)
+            capacity *= 2u;
+        m_entries.resize(capacity, Entry{0u, nullptr, nullptr});
+        m_mask = capacity - 1u;
+
+        for (auto * ppf = &preprocess_pass2_functions[0]; ppf->f; ++ppf) {
+            auto const instrIt(cm.find(ppf->code));
+            if (instrIt == cm.end())
+                continue;
+            auto slot = hash(ppf->code);
+            while (m_entries[slot].description)
+                slot = (slot + 1u) & m_mask;
+            m_entries[slot] = Entry{ppf->code, &instrIt->second, ppf->f};
+        }
+    }
+
+    Entry const * find(std::uint64_t const code) const noexcept {
+        for (auto slot = hash(code);; slot = (slot + 1u) & m_mask) {
+            auto const & entry = m_entries[slot];
+            if (likely(entry.code == code) && likely(entry.description))
+                return &entry;
+            if (!entry.description)
+                return nullptr;
+        }
+    }
+
+    static PreparationTable const & instance() {
+        static PreparationTable const table;
+        return table;
+    }
+
+private: /* Methods: */
+
+    std::size_t hash(std::uint64_t const code) const noexcept {
+        return static_cast<std::size_t>(
+                    (code * 0x9e3779b97f4a7c15u) >> m_shift) & m_mask;
+    }
+
+private: /* Fields: */
+
+    std::vector<Entry> m_entries;
+    std::size_t m_mask;
+    unsigned m_shift;
+
+};
+
 } // anonymous namespace
 
 
@@ -159,26 +240,24 @@ Detail::PreparedSyscallBindings::PreparedSyscallBindings(
 
 template <typename SyscallFinder>
 Detail::PreparedSyscallBindings::PreparedSyscallBindings(
-        std::shared_ptr<Executable::SyscallBindingsSection> parsedBindings,
+        std::vector<std::string> parsedBindings,
         SyscallFinder && syscallFinder)
 {
-    if (parsedBindings) {
-        parseBindings<Program::UndefinedSyscallBindException>(
-            *this,
-            parsedBindings->syscallBindings,
-            [&syscallFinder](PreparedSyscallBindings & r,
-                       std::string const & bindName)
-            {
-                if (auto w = syscallFinder(bindName)) {
-                    r.emplace_back(std::move(w));
-                    return true;
-                }
-                return false;
-            },
-            [&syscallFinder](std::string const & bindName)
-            { return static_cast<bool>(syscallFinder(bindName)); },
-            "Found bindings for undefined systems calls: ");
-    }
+    parseBindings<Program::UndefinedSyscallBindException>(
+        *this,
+        parsedBindings,
+        [&syscallFinder](PreparedSyscallBindings & r,
+                   std::string const & bindName)
+        {
+            if (auto w = syscallFinder(bindName)) {
+                r.emplace_back(std::move(w));
+                return true;
+            }
+            return false;
+        },
+        [&syscallFinder](std::string const & bindName)
+        { return static_cast<bool>(syscallFinder(bindName)); },
+        "Found bindings for undefined systems calls: ");
 }
 
 Detail::PreparedSyscallBindings & Detail::PreparedSyscallBindings::operator=(
@@ -201,56 +280,63 @@ Detail::PreparedLinkingUnit::PreparedLinkingUnit(PreparedLinkingUnit &&)
 
 template <typename SyscallFinder>
 Detail::PreparedLinkingUnit::PreparedLinkingUnit(
-        Executable::LinkingUnit && parsedLinkingUnit,
-        SyscallFinder && syscallFinder)
+        ParsedLinkingUnit && parsedLinkingUnit,
+        SyscallFinder && syscallFinder,
+        bool const countOpcodes,
+        bool const timeSyscalls)
     : codeSection(
-        [](std::shared_ptr<Executable::TextSection> textSection) {
-            if (unlikely(!textSection))
+        [](ParsedLinkingUnit & linkingUnit) {
+            if (unlikely(!linkingUnit.hasTextSection))
                 throw Program::NoCodeSectionException();
-            return std::move(textSection->instructions);
-        }(std::move(parsedLinkingUnit.textSection)))
-    , roDataSection(parsedLinkingUnit.roDataSection
-                    ? std::move(*parsedLinkingUnit.roDataSection)
-                    : Executable::DataSection())
-    , rwDataSection(parsedLinkingUnit.rwDataSection
-                    ? std::move(*parsedLinkingUnit.rwDataSection)
-                    : Executable::DataSection())
-    , bssSectionSize(parsedLinkingUnit.bssSection
-                     ? parsedLinkingUnit.bssSection->sizeInBytes
-                     : 0u)
-    , syscallBindings(std::move(parsedLinkingUnit.syscallBindingsSection),
+            return std::move(linkingUnit.textSection);
+        }(parsedLinkingUnit))
+    , roDataSection(std::move(parsedLinkingUnit.roDataSection))
+    , rwDataSection(std::move(parsedLinkingUnit.rwDataSection))
+    , bssSectionSize(parsedLinkingUnit.bssSectionSize)
+    , timedSyscallSignatures(timeSyscalls
+                             ? parsedLinkingUnit.syscallBindings
+                             : std::vector<std::string>())
+    , syscallBindings(std::move(parsedLinkingUnit.syscallBindings),
                       std::forward<SyscallFinder>(syscallFinder))
 {
+    /* Time the system calls, before their pointers are prepared below: */
+    if (timeSyscalls) {
+        assert(timedSyscallSignatures.size() == syscallBindings.size());
+        for (std::size_t i = 0u; i < syscallBindings.size(); ++i)
+            syscallBindings[i] = makeTimedSyscall(std::move(syscallBindings[i]),
+                                                  i);
+    }
+
     // Prepare the linking unit fully for execution:
     SharemindCodeBlock * const c = codeSection.data();
     assert(c);
 
-    /* Initialize instructions hashmap: */
+    /* Initialize instructions map, remembering the preparation table entries
+       for the second pass, which needs the full instructions map to validate
+       jump targets: */
     std::size_t numInstrs = 0u;
-    auto const & cm = instructionCodeMap();
+    auto const & table = PreparationTable::instance();
     auto const codeSectionSize(codeSection.size());
+    std::vector<PreparationTable::Entry const *> entries;
+    entries.reserve(codeSectionSize);
     for (std::size_t i = 0u; i < codeSectionSize; i++, numInstrs++) {
-        auto const instrIt(cm.find(c[i].uint64[0]));
-        if (instrIt == cm.end())
+        auto const * const entry = table.find(c[i].uint64[0]);
+        if (!entry)
             throw Program::InvalidInstructionException();
-        auto const & instr = instrIt->second;
+        auto const & instr = *entry->description;
         if (i + instr.numArgs >= codeSectionSize)
             throw Program::InvalidInstructionArgumentsException();
         codeSection.registerInstruction(i, numInstrs, instr);
+        entries.emplace_back(entry);
         i += instr.numArgs;
     }
 
-    for (std::size_t i = 0u; i < codeSectionSize; i++) {
-        struct preprocess_pass2_function * ppf =
-                &preprocess_pass2_functions[0];
-        for (;;) {
-            if (!(ppf->f))
-                throw Program::InvalidInstructionException();
-            if (ppf->code == c[i].uint64[0]) {
-                (*(ppf->f))(syscallBindings, codeSection, c, &i);
-                break;
-            }
-            ++ppf;
+    {
+        auto entryIt(entries.cbegin());
+        for (std::size_t i = 0u; i < codeSectionSize; i++, ++entryIt) {
+            assert(entryIt != entries.cend());
+            assert((*entryIt)->code == c[i].uint64[0]);
+            (*((*entryIt)->pass2))(syscallBindings, codeSection, c, &i);
         }
     }
 
@@ -260,6 +346,19 @@ Detail::PreparedLinkingUnit::PreparedLinkingUnit(
                                     Detail::PreparationBlock::EofLabel};
         Detail::vmRun(Detail::ExecuteMethod::GetInstruction, &pb);
     }
+
+    /* Dispatch all instructions through the counting trampoline: */
+    if (countOpcodes) {
+        codeSection.enableOpcodeCounting();
+        for (std::size_t i = 0u; i < codeSectionSize; i++) {
+            if (!codeSection.isInstructionAtOffset(i))
+                continue;
+            Detail::PreparationBlock pb{
+                    &c[i],
+                    Detail::PreparationBlock::CountingLabel};
+            Detail::vmRun(Detail::ExecuteMethod::GetInstruction, &pb);
+        }
+    }
 }
 
 Detail::PreparedLinkingUnit & Detail::PreparedLinkingUnit::operator=(
@@ -272,24 +371,69 @@ Detail::PreparedLinkingUnit & Detail::PreparedLinkingUnit::operator=(
 
 
 
-Detail::PreparedExecutable::PreparedExecutable(PreparedExecutable &&)
-        noexcept(std::is_nothrow_move_constructible<
-                        std::vector<PreparedLinkingUnit> >::value) = default;
-
-template <typename SyscallFinder>
-Detail::PreparedExecutable::PreparedExecutable(Executable parsedExecutable,
-                                               SyscallFinder && syscallFinder)
+Detail::PreparedExecutable::PreparedExecutable(
+        ParsedExecutable parsedExecutable,
+        VmState const & vmState)
     : activeLinkingUnitIndex(std::move(parsedExecutable.activeLinkingUnitIndex))
+    , syscallFinder(vmState.syscallFinder())
+    , countsOpcodes(vmState.m_countOpcodes.load(std::memory_order_relaxed))
+    , timesSyscalls(vmState.m_timeSyscalls.load(std::memory_order_relaxed))
 {
-    linkingUnits.reserve(parsedExecutable.linkingUnits.size());
+    m_linkingUnits.reserve(parsedExecutable.linkingUnits.size());
     for (auto & parsedLinkingUnit : parsedExecutable.linkingUnits)
-        linkingUnits.emplace_back(std::move(parsedLinkingUnit), syscallFinder);
+        m_linkingUnits.emplace_back(
+                    LinkingUnitSlot{std::move(parsedLinkingUnit),
+                                    nullptr,
+                                    nullptr});
+
+    /* Only the active linking unit is ever executed, prepare it eagerly: */
+    auto & activeSlot = m_linkingUnits[activeLinkingUnitIndex];
+    activeSlot.preparedLinkingUnit = prepareLinkingUnit(activeSlot, vmState);
 }
 
-Detail::PreparedExecutable & Detail::PreparedExecutable::operator=(
-        PreparedExecutable &&)
-        noexcept(std::is_nothrow_move_assignable<
-                        std::vector<PreparedLinkingUnit> >::value) = default;
+Detail::PreparedExecutable::~PreparedExecutable() noexcept = default;
+
+std::unique_ptr<Detail::PreparedLinkingUnit>
+Detail::PreparedExecutable::prepareLinkingUnit(LinkingUnitSlot & slot,
+                                               VmState const & vmState) const
+{
+    return std::make_unique<PreparedLinkingUnit>(
+                std::move(slot.parsedLinkingUnit),
+                [this, &vmState](std::string const & syscallSignature) {
+                    return vmState.findSyscall(syscallSignature,
+                                               &syscallFinder);
+                },
+                countsOpcodes,
+                timesSyscalls);
+}
+
+Detail::PreparedLinkingUnit const * Detail::PreparedExecutable::
+        preparedLinkingUnit(std::size_t const index) const noexcept
+{
+    assert(index < m_linkingUnits.size());
+    std::lock_guard<std::mutex> const guard(m_mutex);
+    return m_linkingUnits[index].preparedLinkingUnit.get();
+}
+
+Detail::PreparedLinkingUnit const & Detail::PreparedExecutable::linkingUnit(
+        std::size_t const index,
+        VmState const & vmState) const
+{
+    assert(index < m_linkingUnits.size());
+    auto & slot = m_linkingUnits[index];
+    std::lock_guard<std::mutex> const guard(m_mutex);
+    if (slot.preparedLinkingUnit)
+        return *slot.preparedLinkingUnit;
+    if (slot.preparationError)
+        std::rethrow_exception(slot.preparationError);
+    try {
+        slot.preparedLinkingUnit = prepareLinkingUnit(slot, vmState);
+    } catch (...) {
+        slot.preparationError = std::current_exception();
+        throw;
+    }
+    return *slot.preparedLinkingUnit;
+}
 
 
 Detail::ProgramState::ProgramState(
@@ -301,15 +445,41 @@ Detail::ProgramState::ProgramState(
 
 Detail::ProgramState::~ProgramState() noexcept = default;
 
+std::shared_ptr<Detail::MemorySlot const>
+Detail::ProgramState::sharedSegment(std::string const & name) const {
+    std::lock_guard<std::mutex> const guard(m_mutex);
+    auto const it(m_sharedSegments.find(name));
+    return (it != m_sharedSegments.end()) ? it->second : nullptr;
+}
+
+void Detail::ProgramState::addSyscallStatistics(
+        Vm::SyscallStatisticsMap const & statistics)
+{
+    std::lock_guard<std::mutex> const guard(m_mutex);
+    for (auto const & syscallStatistics : statistics)
+        m_syscallStatistics[syscallStatistics.first] +=
+                syscallStatistics.second;
+}
+
 std::shared_ptr<void> Detail::ProgramState::findProcessFacility(
         char const * name) const noexcept
 {
-    std::lock_guard<std::mutex> const guard(m_mutex);
-    if (m_processFacilityFinder && *m_processFacilityFinder)
-        return (*m_processFacilityFinder)(name);
+    Vm::FacilityFinderFunPtr finder;
+    {
+        std::lock_guard<std::mutex> const guard(m_mutex);
+        finder = m_processFacilityFinder;
+    }
+    if (finder && *finder)
+        return (*finder)(name);
     return m_vmState->findProcessFacility(name);
 }
 
+Detail::PreparedLinkingUnit const & Detail::ProgramState::linkingUnit(
+        std::size_t const index) const
+{
+    return m_preparedExecutable->linkingUnit(index, *m_vmState);
+}
+
 
 SHAREMIND_DEFINE_EXCEPTION_NOINLINE(sharemind::Exception, Program::, Exception);
 SHAREMIND_DEFINE_EXCEPTION_NOINLINE(IoException, Program::, IoException);
@@ -321,6 +491,7 @@ EC(Io, FileNo, "Failed fileno()!");
 EC(Io, FileFstat, "Failed fstat()!");
 EC(Io, FileRead, "Failed to read() all data from file!");
 EC(, ImplementationLimitsReached, "Implementation limits reached!");
+EC(, InvalidLinkingUnitIndex, "Invalid linking unit index given!");
 SHAREMIND_DEFINE_EXCEPTION_NOINLINE(Exception, Program::,PrepareException);
 EC(Prepare, InvalidFileHeader, "Invalid executable file header!");
 EC(Prepare, VersionMismatch, "Executable file format version not supported!");
@@ -425,8 +596,17 @@ std::shared_ptr<Detail::PreparedExecutable> Program::Inner::loadFromMemory(
         std::size_t dataSize)
 {
     assert(data);
-    InputMemoryStream inStream(static_cast<char const *>(data), dataSize);
-    return loadFromStream(vmInner, inStream);
+    if (Detail::GzipExecutableReader::hasMagic(data, dataSize)) {
+        Detail::GzipExecutableReader reader(
+                    data,
+                    dataSize,
+                    vmInner.m_maxInflatedExecutableSize.load(
+                        std::memory_order_relaxed));
+        return loadFromParsedExecutable(vmInner,
+                                        Detail::parseExecutable(reader));
+    }
+    Detail::MemoryExecutableReader reader(data, dataSize);
+    return loadFromParsedExecutable(vmInner, Detail::parseExecutable(reader));
 }
 
 std::shared_ptr<Detail::PreparedExecutable> Program::Inner::loadFromStream(
@@ -453,14 +633,22 @@ std::shared_ptr<Detail::PreparedExecutable> Program::Inner::loadFromStream(
 std::shared_ptr<Detail::PreparedExecutable> Program::Inner::loadFromExecutable(
             Vm::Inner const & vmInner,
             Executable && executable)
+{
+    return loadFromParsedExecutable(
+                vmInner,
+                Detail::ParsedExecutable(std::move(executable)));
+}
+
+std::shared_ptr<Detail::PreparedExecutable>
+Program::Inner::loadFromParsedExecutable(
+        Vm::Inner const & vmInner,
+        Detail::ParsedExecutable && executable)
 {
     assert(!executable.linkingUnits.empty());
     assert(executable.activeLinkingUnitIndex < executable.linkingUnits.size());
 
-    return std::make_shared<Detail::PreparedExecutable>(
-                std::move(executable),
-                [&vmInner](std::string const & syscallSignature)
-                { return vmInner.findSyscall(syscallSignature); });
+    return std::make_shared<Detail::PreparedExecutable>(std::move(executable),
+                                                        vmInner);
 }
 
 
@@ -507,25 +695,77 @@ VmInstructionInfo const * Program::instruction(
         std::size_t codeSection,
         std::size_t instructionIndex) const noexcept
 {
-    {
-        assert(m_inner->m_preparedExecutable);
-        auto const & preparedExecutable = *m_inner->m_preparedExecutable;
-        if (codeSection < preparedExecutable.linkingUnits.size()) {
-            auto const & cs =
-                    preparedExecutable.linkingUnits[codeSection].codeSection;
-            return cs.instructionDescriptionAtOffset(instructionIndex);
-        }
-    }
+    assert(m_inner->m_preparedExecutable);
+    auto const & preparedExecutable = *m_inner->m_preparedExecutable;
+    if (codeSection < preparedExecutable.numLinkingUnits())
+        if (auto const * const linkingUnit =
+                    preparedExecutable.preparedLinkingUnit(codeSection))
+            return linkingUnit->codeSection.instructionDescriptionAtOffset(
+                        instructionIndex);
     return nullptr;
 }
 
+Vm::SyscallStatisticsMap Program::syscallStatistics() const {
+    std::lock_guard<std::mutex> const guard(m_inner->m_mutex);
+    return m_inner->m_syscallStatistics;
+}
+
+void Program::prepareLinkingUnit(std::size_t linkingUnitIndex) const {
+    assert(m_inner->m_preparedExecutable);
+    if (linkingUnitIndex >= m_inner->m_preparedExecutable->numLinkingUnits())
+        throw InvalidLinkingUnitIndexException();
+    m_inner->linkingUnit(linkingUnitIndex);
+}
+
 void Program::setProcessFacilityFinder(Vm::FacilityFinderFunPtr f) noexcept {
     std::lock_guard<std::mutex> const guard(m_inner->m_mutex);
     m_inner->m_processFacilityFinder = std::move(f);
+    m_inner->m_facilityFinderGeneration.fetch_add(1u,
+                                                  std::memory_order_release);
 }
 
 std::shared_ptr<void> Program::findProcessFacility(char const * name)
         const noexcept
 { return m_inner->findProcessFacility(name); }
 
+std::vector<Process> Program::createProcesses(std::size_t const numProcesses)
+{
+    assert(m_inner);
+    std::vector<Process> r;
+    if (!numProcesses)
+        return r;
+    r.reserve(numProcesses);
+    assert(m_inner->m_preparedExecutable);
+    auto const & linkingUnit =
+            m_inner->m_preparedExecutable->activeLinkingUnit();
+    Detail::DataSectionBatch dataSectionBatch(linkingUnit.rwDataSection,
+                                              linkingUnit.bssSectionSize,
+                                              numProcesses);
+    Detail::BatchAllocator<Process::Inner> const allocator(
+                std::make_shared<Detail::BatchArena>(numProcesses));
+    for (std::size_t i = 0u; i < numProcesses; ++i)
+        r.push_back(Process(std::allocate_shared<Process::Inner>(
+                                allocator,
+                                m_inner,
+                                &dataSectionBatch)));
+    return r;
+}
+
+void Program::addSharedSegment(std::string name,
+                               std::shared_ptr<void const> data,
+                               std::size_t const size)
+{
+    assert(m_inner);
+    std::shared_ptr<Detail::MemorySlot const> segment(
+                std::make_shared<Detail::InputMemory>(std::move(data), size));
+    std::lock_guard<std::mutex> const guard(m_inner->m_mutex);
+    m_inner->m_sharedSegments[std::move(name)] = std::move(segment);
+}
+
+bool Program::removeSharedSegment(std::string const & name) noexcept {
+    assert(m_inner);
+    std::lock_guard<std::mutex> const guard(m_inner->m_mutex);
+    return m_inner->m_sharedSegments.erase(name) != 0u;
+}
+
 } // namespace sharemind {
@@ -27,6 +27,9 @@
 #include <sharemind/ExceptionMacros.h>
 #include <sharemind/libexecutable/Executable.h>
 #include <sharemind/libvmi/instr.h>
+#include <string>
+#include <vector>
+#include "Process.h"
 #include "Vm.h"
 
 
@@ -55,6 +58,9 @@ public: /* Types: */
     SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(
             Exception,
             ImplementationLimitsReachedException);
+    SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(
+            Exception,
+            InvalidLinkingUnitIndexException);
     SHAREMIND_DECLARE_EXCEPTION_NOINLINE(Exception, PrepareException);
     SHAREMIND_DECLARE_EXCEPTION_CONST_MSG_NOINLINE(PrepareException,
                                                    InvalidFileHeaderException);
@@ -153,10 +159,35 @@ public: /* Methods: */
 
     Program & operator=(Program const &) noexcept = delete;
 
+    /**
+      \returns the description of the given instruction, or nullptr if no such
+               instruction exists or the linking unit has not been prepared.
+      \see prepareLinkingUnit()
+    */
     VmInstructionInfo const * instruction(std::size_t codeSection,
                                           std::size_t instructionIndex)
             const noexcept;
 
+    /**
+      \returns the system call statistics of all destroyed processes of this
+               program, if it was loaded with the statistics enabled.
+      \see Vm::setSyscallStatisticsEnabled()
+    */
+    Vm::SyscallStatisticsMap syscallStatistics() const;
+
+    /**
+      \brief Prepares the linking unit with the given index for execution.
+      \details Only the active linking unit is prepared when the program is
+               loaded, other linking units are prepared on demand. All
+               linking units are prepared with the syscall finder, opcode
+               counting and system call statistics settings the VM had when
+               the program was loaded.
+      \param[in] linkingUnitIndex The index of the linking unit to prepare.
+      \throws InvalidLinkingUnitIndexException if no such linking unit exists.
+      \throws PrepareException if preparing the linking unit failed.
+    */
+    void prepareLinkingUnit(std::size_t linkingUnitIndex) const;
+
     void setProcessFacilityFinder(Vm::FacilityFinderFunPtr f) noexcept;
 
     template <typename F>
@@ -176,6 +207,48 @@ public: /* Methods: */
 
     std::shared_ptr<void> findProcessFacility(char const * name) const noexcept;
 
+    /**
+      \brief Creates the given number of processes of this program at once.
+      \details Equivalent to constructing the processes one by one, but the
+               states of the processes are allocated as a single contiguous
+               chunk of memory with each state aligned to a cache line. The
+               writable data sections of the processes (the section objects
+               and their contents) are likewise allocated from chunks shared
+               by the whole batch. The chunks are released when the last of
+               their users is destroyed. Call stack frames and memory
+               allocated at runtime are still allocated per process.
+    */
+    std::vector<Process> createProcesses(std::size_t numProcesses);
+
+    /**
+      \brief Registers an immutable memory segment shared by all processes of
+             this program, e.g. a reference table.
+      \details The segment is mapped as read-only public memory into a
+               process the first time the process asks for it via the
+               "Process_getSharedSegment" system call, which takes the name as
+               a constant reference and returns the public memory pointer of
+               the segment, or 0 if there is no such segment. The memory is
+               never copied. A segment with the same name is replaced, but the
+               processes which have already mapped it keep the old segment.
+               Like inputs, the size of a mapped segment counts towards the
+               public heap usage of a process, but is not subject to its
+               limits.
+      \param[in] name The name of the segment.
+      \param[in] data The segment, which must not be modified while
+                      registered or mapped.
+      \param[in] size The size of the segment in bytes.
+    */
+    void addSharedSegment(std::string name,
+                          std::shared_ptr<void const> data,
+                          std::size_t size);
+
+    /**
+      \brief Unregisters the named shared memory segment.
+      \details Processes which have already mapped the segment keep it.
+      \returns whether such a segment was registered.
+    */
+    bool removeSharedSegment(std::string const & name) noexcept;
+
 private: /* Fields: */
 
     std::shared_ptr<Inner> m_inner;
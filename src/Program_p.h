@@ -24,12 +24,20 @@
 #error including an internal header!
 #endif
 
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <exception>
+#include <memory>
 #include <mutex>
 #include <sharemind/libexecutable/Executable.h>
+#include <string>
 #include <vector>
 #include <type_traits>
+#include <unordered_map>
 #include "CodeSection.h"
 #include "DataSection.h"
+#include "ExecutableParser.h"
 #include "Program.h"
 #include "Vm.h"
 #include "Vm_p.h"
@@ -53,7 +61,7 @@ struct __attribute__((visibility("internal"))) PreparedSyscallBindings
 
     template <typename SyscallFinder>
     PreparedSyscallBindings(
-            std::shared_ptr<Executable::SyscallBindingsSection> parsedBindings,
+            std::vector<std::string> parsedBindings,
             SyscallFinder && syscallFinder);
 
     PreparedSyscallBindings & operator=(PreparedSyscallBindings &&)
@@ -68,9 +76,17 @@ struct __attribute__((visibility("internal"))) PreparedLinkingUnit {
 
 /* Methods: */
 
+    /**
+      \param[in] countOpcodes Whether to dispatch all instructions through the
+                              opcode counting trampoline.
+      \param[in] timeSyscalls Whether to wrap the system call bindings to
+                              collect statistics.
+    */
     template <typename SyscallFinder>
-    PreparedLinkingUnit(Executable::LinkingUnit && parsedLinkingUnit,
-                        SyscallFinder && syscallFinder);
+    PreparedLinkingUnit(ParsedLinkingUnit && parsedLinkingUnit,
+                        SyscallFinder && syscallFinder,
+                        bool const countOpcodes,
+                        bool const timeSyscalls);
 
     PreparedLinkingUnit(PreparedLinkingUnit &&)
             noexcept(std::is_nothrow_move_constructible<CodeSection>::value
@@ -94,33 +110,93 @@ struct __attribute__((visibility("internal"))) PreparedLinkingUnit {
     RoDataSection roDataSection;
     RwDataSection rwDataSection;
     std::size_t bssSectionSize;
+    /** The binding signatures if the bindings are timed, empty otherwise. */
+    std::vector<std::string> timedSyscallSignatures;
     PreparedSyscallBindings syscallBindings;
 
 };
 
 struct __attribute__((visibility("internal"))) PreparedExecutable {
 
+/* Types: */
+
+    struct LinkingUnitSlot {
+
+    /* Fields: */
+
+        /// Consumed when the linking unit is prepared:
+        ParsedLinkingUnit parsedLinkingUnit;
+        std::unique_ptr<PreparedLinkingUnit> preparedLinkingUnit;
+        std::exception_ptr preparationError;
+
+    };
+
 /* Methods: */
 
     PreparedExecutable() = delete;
-    PreparedExecutable(PreparedExecutable &&)
-            noexcept(std::is_nothrow_move_constructible<
-                            std::vector<PreparedLinkingUnit> >::value);
+    PreparedExecutable(PreparedExecutable &&) = delete;
     PreparedExecutable(PreparedExecutable const &) = delete;
 
-    template <typename SyscallFinder>
-    PreparedExecutable(Executable parsedExecutable,
-                       SyscallFinder && syscallFinder);
+    /**
+      \brief Prepares the active linking unit of the given executable for
+             execution. Other linking units are only prepared on demand.
+      \details The syscall finder and the preparation flags of the VM are
+               captured, so that linking units prepared later are prepared
+               like the active one.
+    */
+    PreparedExecutable(ParsedExecutable parsedExecutable,
+                       VmState const & vmState);
 
-    PreparedExecutable & operator=(PreparedExecutable &&)
-            noexcept(std::is_nothrow_move_assignable<
-                            std::vector<PreparedLinkingUnit> >::value);
+    ~PreparedExecutable() noexcept;
+
+    PreparedExecutable & operator=(PreparedExecutable &&) = delete;
     PreparedExecutable & operator=(PreparedExecutable const &) = delete;
 
-/* Fields: */
+    std::size_t numLinkingUnits() const noexcept
+    { return m_linkingUnits.size(); }
+
+    PreparedLinkingUnit const & activeLinkingUnit() const noexcept {
+        assert(m_linkingUnits[activeLinkingUnitIndex].preparedLinkingUnit);
+        return *m_linkingUnits[activeLinkingUnitIndex].preparedLinkingUnit;
+    }
+
+    /**
+      \brief Returns the linking unit with the given index, preparing it first
+             if needed.
+      \param[in] vmState The VM the executable was loaded by.
+      \throws Any exception thrown during preparing the linking unit, also on
+              every subsequent call for the same linking unit.
+    */
+    PreparedLinkingUnit const & linkingUnit(std::size_t const index,
+                                            VmState const & vmState) const;
+
+    /**
+      \returns the linking unit with the given index, or nullptr if it has not
+               been prepared.
+    */
+    PreparedLinkingUnit const * preparedLinkingUnit(std::size_t const index)
+            const noexcept;
+
+private: /* Methods: */
+
+    std::unique_ptr<PreparedLinkingUnit> prepareLinkingUnit(
+            LinkingUnitSlot & slot,
+            VmState const & vmState) const;
+
+public: /* Fields: */
+
+    std::size_t const activeLinkingUnitIndex;
+    /** The syscall finder of the VM when the executable was loaded. */
+    SyscallFinderSnapshot const syscallFinder;
+    /** Whether the linking units count executed instructions. */
+    bool const countsOpcodes;
+    /** Whether the system call bindings of the linking units are timed. */
+    bool const timesSyscalls;
+
+private: /* Fields: */
 
-    std::vector<PreparedLinkingUnit> linkingUnits;
-    std::size_t activeLinkingUnitIndex;
+    mutable std::mutex m_mutex;
+    mutable std::vector<LinkingUnitSlot> m_linkingUnits;
 
 };
 
@@ -135,10 +211,30 @@ struct __attribute__((visibility("internal"))) ProgramState {
 
     std::shared_ptr<void> findProcessFacility(char const * name) const noexcept;
 
+    PreparedLinkingUnit const & linkingUnit(std::size_t const index) const;
+
+    /** \returns the named shared segment, or nullptr if there is none. */
+    std::shared_ptr<MemorySlot const> sharedSegment(std::string const & name)
+            const;
+
+    /** \brief Adds the system call statistics of a destroyed process. */
+    void addSyscallStatistics(Vm::SyscallStatisticsMap const & statistics);
+
 /* Fields: */
 
     mutable std::mutex m_mutex;
+    /** The read-only segments shared by all processes, guarded by m_mutex. */
+    std::unordered_map<std::string, std::shared_ptr<MemorySlot const> >
+            m_sharedSegments;
+    /** Guarded by m_mutex. */
+    Vm::SyscallStatisticsMap m_syscallStatistics;
+    /** Guarded by m_mutex. */
     Vm::FacilityFinderFunPtr m_processFacilityFinder;
+    /**
+      \brief Incremented whenever m_processFacilityFinder is replaced.
+      \details Used to invalidate memoized process facility lookups.
+    */
+    std::atomic<std::uint64_t> m_facilityFinderGeneration{0u};
     std::shared_ptr<VmState> m_vmState;
 
     std::shared_ptr<Detail::PreparedExecutable const> const
@@ -184,6 +280,10 @@ struct __attribute__((visibility("internal"))) Program::Inner final
                 Vm::Inner const & vmInner,
                 Executable && executable);
 
+    static std::shared_ptr<Detail::PreparedExecutable>
+    loadFromParsedExecutable(Vm::Inner const & vmInner,
+                             Detail::ParsedExecutable && executable);
+
 }; /* struct Program::Inner */
 
 } /* namespace sharemind { */
@@ -33,10 +33,19 @@ PublicMemory::PublicMemory(std::size_t const size) noexcept
     , m_size(size)
 { std::memset(m_data, 0, size); }
 
+PublicMemory::PublicMemory(PublicMemory const & copy)
+    : MemorySlot()
+    , m_data(::operator new(copy.m_size))
+    , m_size(copy.m_size)
+{ std::memcpy(m_data, copy.m_data, m_size); }
+
 PublicMemory::~PublicMemory() noexcept { ::operator delete(m_data); }
 
 void * PublicMemory::data() const noexcept { return m_data; }
 std::size_t PublicMemory::size() const noexcept { return m_size; }
 
+std::shared_ptr<MemorySlot> PublicMemory::clone() const
+{ return std::make_shared<PublicMemory>(*this); }
+
 } // namespace Detail {
 } // namespace sharemind {
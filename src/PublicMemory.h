@@ -35,10 +35,12 @@ class __attribute__((visibility("internal"))) PublicMemory: public MemorySlot {
 public: /* Methods: */
 
     PublicMemory(std::size_t const size) noexcept;
+    PublicMemory(PublicMemory const & copy);
     ~PublicMemory() noexcept override;
 
     void * data() const noexcept final override;
     std::size_t size() const noexcept final override;
+    std::shared_ptr<MemorySlot> clone() const final override;
 
 private: /* Fields: */
 
@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+#include "Scheduler.h"
+#include "Scheduler_p.h"
+
+#include <algorithm>
+#include <cassert>
+#include <sharemind/likely.h>
+#include <utility>
+#include "Process_p.h"
+
+
+namespace sharemind {
+
+namespace {
+
+constexpr auto const defaultTimeSlice = std::chrono::milliseconds(10);
+
+std::size_t defaultNumWorkers() noexcept {
+    auto const r = std::thread::hardware_concurrency();
+    return r ? r : 1u;
+}
+
+} // anonymous namespace
+
+namespace Detail {
+
+SchedulerState::SchedulerState(std::size_t numWorkers,
+                               std::chrono::nanoseconds timeSlice)
+    : m_timeSlice(timeSlice)
+{
+    numWorkers = std::max(numWorkers, std::size_t(1u));
+    m_workers.reserve(numWorkers);
+    for (std::size_t i = 0u; i < numWorkers; ++i)
+        m_workers.emplace_back(std::make_unique<Worker>());
+    try {
+        for (std::size_t i = 0u; i < numWorkers; ++i)
+            m_workers[i]->thread =
+                    std::thread(&SchedulerState::workerLoop, this, i);
+        m_timerThread = std::thread(&SchedulerState::timerLoop, this);
+    } catch (...) {
+        stop();
+        throw;
+    }
+}
+
+SchedulerState::~SchedulerState() noexcept { stop(); }
+
+void SchedulerState::stop() noexcept {
+    {
+        std::lock_guard<std::mutex> const guard(m_idleMutex);
+        m_stop.store(true, std::memory_order_relaxed);
+    }
+    m_idleCondition.notify_all();
+    m_timerCondition.notify_all();
+
+    /* Preempt running processes: */
+    for (auto const & worker : m_workers) {
+        std::lock_guard<std::mutex> const guard(worker->runMutex);
+        if (worker->running)
+            worker->running->pause();
+    }
+
+    for (auto const & worker : m_workers)
+        if (worker->thread.joinable())
+            worker->thread.join();
+    if (m_timerThread.joinable())
+        m_timerThread.join();
+}
+
+void SchedulerState::submit(Process process,
+                            void const * const key,
+                            bool started,
+                            Scheduler::CompletionCallback callback)
+{
+    process.setWakeupCallback(
+                [weakState = std::weak_ptr<SchedulerState>(shared_from_this()),
+                 key]() noexcept
+                {
+                    if (auto const state = weakState.lock())
+                        state->wakeup(key);
+                });
+    auto const workerIndex =
+            m_nextWorker.fetch_add(1u, std::memory_order_relaxed)
+            % m_workers.size();
+    enqueue(workerIndex,
+            Task{std::move(process), key, started, std::move(callback)});
+}
+
+void SchedulerState::enqueue(std::size_t const workerIndex, Task task) {
+    auto & worker = *m_workers[workerIndex];
+    {
+        std::lock_guard<std::mutex> const guard(worker.queueMutex);
+        worker.queue.emplace_back(std::move(task));
+    }
+    m_numQueued.fetch_add(1u, std::memory_order_release);
+    {
+        /* Synchronize with workers checking the predicate before waiting: */
+        std::lock_guard<std::mutex> const guard(m_idleMutex);
+    }
+    m_idleCondition.notify_one();
+}
+
+bool SchedulerState::dequeue(std::size_t const workerIndex, Task & task) {
+    auto const numWorkers = m_workers.size();
+    for (std::size_t i = 0u; i < numWorkers; ++i) {
+        auto & worker = *m_workers[(workerIndex + i) % numWorkers];
+        std::lock_guard<std::mutex> const guard(worker.queueMutex);
+        if (worker.queue.empty())
+            continue;
+        /* Take from the front of the own queue, steal from the back: */
+        if (i == 0u) {
+            task = std::move(worker.queue.front());
+            worker.queue.pop_front();
+        } else {
+            task = std::move(worker.queue.back());
+            worker.queue.pop_back();
+        }
+        m_numQueued.fetch_sub(1u, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void SchedulerState::workerLoop(std::size_t const workerIndex) noexcept {
+    Task task;
+    while (!m_stop.load(std::memory_order_relaxed)) {
+        if (dequeue(workerIndex, task)) {
+            execute(workerIndex, task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_idleMutex);
+        m_idleCondition.wait(
+                    lock,
+                    [this]() noexcept {
+                        return m_stop.load(std::memory_order_relaxed)
+                               || m_numQueued.load(std::memory_order_acquire);
+                    });
+    }
+}
+
+void SchedulerState::execute(std::size_t const workerIndex, Task & task)
+        noexcept
+{
+    auto & worker = *m_workers[workerIndex];
+    {
+        std::lock_guard<std::mutex> const guard(worker.runMutex);
+        /* Checked under runMutex to not miss the preemption by stop(): */
+        if (m_stop.load(std::memory_order_relaxed))
+            return;
+        worker.running = &task.process;
+        worker.runningSince = std::chrono::steady_clock::now();
+    }
+    std::exception_ptr exception;
+    auto result = Process::ExecutionResult::Finished;
+    try {
+        if (task.started) {
+            result = task.process.tryResume();
+        } else {
+            task.started = true;
+            result = task.process.tryRun();
+        }
+    } catch (...) {
+        exception = std::current_exception();
+    }
+    {
+        std::lock_guard<std::mutex> const guard(worker.runMutex);
+        worker.running = nullptr;
+    }
+
+    if (result != Process::ExecutionResult::Finished) {
+        if (m_stop.load(std::memory_order_relaxed))
+            return;
+        try {
+            /* Parked until woken up by the wakeup callback: */
+            if ((result == Process::ExecutionResult::Suspended)
+                || (result == Process::ExecutionResult::Held))
+                return park(workerIndex, task);
+            return enqueue(workerIndex, std::move(task));
+        } catch (...) {
+            exception = std::current_exception();
+        }
+    }
+    complete(task, std::move(exception));
+}
+
+void SchedulerState::park(std::size_t const workerIndex, Task & task) {
+    {
+        std::lock_guard<std::mutex> const guard(m_parkedMutex);
+        auto const it(m_woken.find(task.key));
+        if (it == m_woken.end()) {
+            m_parked.emplace(task.key, std::move(task));
+            return;
+        }
+        m_woken.erase(it);
+    }
+    enqueue(workerIndex, std::move(task));
+}
+
+void SchedulerState::wakeup(void const * const key) noexcept {
+    Task task;
+    try {
+        {
+            std::lock_guard<std::mutex> const guard(m_parkedMutex);
+            auto const it(m_parked.find(key));
+            if (it == m_parked.end()) {
+                /* Woken before parked, let park() requeue it: */
+                m_woken.emplace(key);
+                return;
+            }
+            task = std::move(it->second);
+            m_parked.erase(it);
+        }
+        if (m_stop.load(std::memory_order_relaxed))
+            return;
+        enqueue(m_nextWorker.fetch_add(1u, std::memory_order_relaxed)
+                % m_workers.size(),
+                std::move(task));
+    } catch (...) {
+        if (task.onCompletion)
+            complete(task, std::current_exception());
+    }
+}
+
+void SchedulerState::complete(Task & task, std::exception_ptr exception)
+        noexcept
+{
+    try {
+        task.onCompletion(std::move(task.process), std::move(exception));
+    } catch (...) {} // Exceptions from callbacks are ignored
+    task.onCompletion = nullptr;
+}
+
+void SchedulerState::timerLoop() noexcept {
+    auto const interval =
+            std::max(m_timeSlice / 2,
+                     std::chrono::nanoseconds(std::chrono::microseconds(100)));
+    std::unique_lock<std::mutex> lock(m_idleMutex);
+    while (!m_timerCondition.wait_for(lock,
+                                      interval,
+                                      [this]() noexcept
+                                      { return m_stop.load(); }))
+    {
+        lock.unlock();
+        auto const now = std::chrono::steady_clock::now();
+        for (auto const & worker : m_workers) {
+            std::lock_guard<std::mutex> const guard(worker->runMutex);
+            if (worker->running && (now - worker->runningSince >= m_timeSlice))
+                worker->running->pause();
+        }
+        lock.lock();
+    }
+}
+
+} // namespace Detail {
+
+
+Scheduler::Scheduler() : Scheduler(defaultNumWorkers(), defaultTimeSlice) {}
+
+Scheduler::Scheduler(std::size_t numWorkers, std::chrono::nanoseconds timeSlice)
+    : m_inner(std::make_shared<Inner>(numWorkers, timeSlice))
+{}
+
+Scheduler::~Scheduler() noexcept {
+    /* Wakeup callbacks might keep the state alive, but must not use it: */
+    m_inner->stop();
+}
+
+std::future<Process> Scheduler::submit(Process process) {
+    auto promise(std::make_shared<std::promise<Process> >());
+    auto future(promise->get_future());
+    submit(std::move(process),
+           [promise](Process p, std::exception_ptr e) {
+               if (e) {
+                   promise->set_exception(std::move(e));
+               } else {
+                   promise->set_value(std::move(p));
+               }
+           });
+    return future;
+}
+
+void Scheduler::submit(Process process, CompletionCallback callback) {
+    assert(process.m_inner);
+    bool started;
+    {
+        auto const state =
+                process.m_inner->m_state.load(std::memory_order_acquire);
+        if (state == Process::Inner::State::Initialized) {
+            started = false;
+        } else if (likely(state == Process::Inner::State::Trapped)) {
+            started = true;
+        } else {
+            throw Process::NotInInitializedOrTrappedStateException();
+        }
+    }
+    void const * const key = process.m_inner.get();
+    m_inner->submit(std::move(process), key, started, std::move(callback));
+}
+
+} // namespace sharemind {
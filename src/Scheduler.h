@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+#ifndef SHAREMIND_LIBVM_SCHEDULER_H
+#define SHAREMIND_LIBVM_SCHEDULER_H
+
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include "Process.h"
+
+
+namespace sharemind {
+
+/**
+  \brief Runs processes on a fixed pool of worker threads.
+  \details Every worker thread has its own run queue, idle workers steal
+           processes from the queues of other workers. A process which has run
+           for longer than the time slice is paused via Process::pause() and
+           put back to the run queue, so that long-running processes can not
+           starve other processes.
+           Processes suspended in asynchronous system calls or held by a
+           paused ProcessGroup do not occupy a worker thread, they are put back
+           to a run queue when woken up.
+  \note Since the time slicing is based on Process::pause(), calling
+        Process::pause() on a scheduled process only makes it yield, use a
+        ProcessGroup to keep scheduled processes from running. The
+        wakeup callbacks of scheduled processes are replaced by the scheduler.
+*/
+class Scheduler {
+
+private: /* Types: */
+
+    struct Inner;
+
+public: /* Types: */
+
+    /**
+      \brief The type of callbacks called on process completion.
+      \details The callback is given the process and nullptr, if the process
+               finished, or the exception the process crashed with otherwise.
+      \note Callbacks are called on worker threads. Exceptions thrown by
+            callbacks are ignored.
+    */
+    using CompletionCallback =
+            std::function<void (Process, std::exception_ptr)>;
+
+public: /* Methods: */
+
+    /**
+      \brief Constructs a scheduler with one worker per hardware thread and the
+             default time slice.
+    */
+    Scheduler();
+
+    /**
+      \param[in] numWorkers The number of worker threads, at least one.
+      \param[in] timeSlice The time a process may run before it is preempted.
+    */
+    Scheduler(std::size_t numWorkers, std::chrono::nanoseconds timeSlice);
+
+    Scheduler(Scheduler &&) noexcept = delete;
+    Scheduler(Scheduler const &) noexcept = delete;
+
+    /**
+      \brief Stops all worker threads.
+      \details Running processes are paused and the processes not yet finished
+               are destroyed without calling their callbacks. Their futures are
+               made ready with a std::future_error.
+    */
+    virtual ~Scheduler() noexcept;
+
+    Scheduler & operator=(Scheduler &&) noexcept = delete;
+    Scheduler & operator=(Scheduler const &) noexcept = delete;
+
+    /**
+      \brief Schedules the given process to be run or resumed.
+      \param[in] process The process to schedule, must be in initialized or in
+                         trapped state.
+      \returns a future which receives the process after it has finished, or
+               the exception the process crashed with.
+      \throws Process::NotInInitializedOrTrappedStateException if the process
+              is neither in initialized nor in trapped state.
+    */
+    std::future<Process> submit(Process process);
+
+    /**
+      \brief Schedules the given process to be run or resumed.
+      \param[in] process The process to schedule, must be in initialized or in
+                         trapped state.
+      \param[in] callback The callback to call when the process has finished or
+                          crashed.
+      \throws Process::NotInInitializedOrTrappedStateException if the process
+              is neither in initialized nor in trapped state.
+    */
+    void submit(Process process, CompletionCallback callback);
+
+private: /* Fields: */
+
+    std::shared_ptr<Inner> m_inner;
+
+}; /* class Scheduler */
+
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_LIBVM_SCHEDULER_H */
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+#ifndef SHAREMIND_LIBVM_SCHEDULER_P_H
+#define SHAREMIND_LIBVM_SCHEDULER_P_H
+
+#ifndef SHAREMIND_INTERNAL_
+#error including an internal header!
+#endif
+
+#include "Scheduler.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Process.h"
+
+
+namespace sharemind {
+namespace Detail {
+
+class __attribute__((visibility("internal"))) SchedulerState
+    : public std::enable_shared_from_this<SchedulerState>
+{
+
+private: /* Types: */
+
+    struct Task {
+        Process process;
+        /** Identifies the process while suspended in a system call. */
+        void const * key;
+        bool started;
+        Scheduler::CompletionCallback onCompletion;
+    };
+
+    struct Worker {
+        std::mutex queueMutex;
+        std::deque<Task> queue;
+
+        /* The process currently run by this worker, guarded by runMutex: */
+        std::mutex runMutex;
+        Process * running = nullptr;
+        std::chrono::steady_clock::time_point runningSince;
+
+        std::thread thread;
+    };
+
+public: /* Methods: */
+
+    SchedulerState(std::size_t numWorkers, std::chrono::nanoseconds timeSlice);
+    ~SchedulerState() noexcept;
+
+    void submit(Process process,
+                void const * key,
+                bool started,
+                Scheduler::CompletionCallback callback);
+
+    void stop() noexcept;
+
+private: /* Methods: */
+
+    void enqueue(std::size_t workerIndex, Task task);
+    bool dequeue(std::size_t workerIndex, Task & task);
+    void workerLoop(std::size_t workerIndex) noexcept;
+    void execute(std::size_t workerIndex, Task & task) noexcept;
+    void park(std::size_t workerIndex, Task & task);
+    void wakeup(void const * key) noexcept;
+    void complete(Task & task, std::exception_ptr exception) noexcept;
+    void timerLoop() noexcept;
+
+private: /* Fields: */
+
+    std::chrono::nanoseconds const m_timeSlice;
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    std::atomic<std::size_t> m_nextWorker{0u};
+
+    /** The number of tasks in all run queues. */
+    std::atomic<std::size_t> m_numQueued{0u};
+    std::mutex m_idleMutex;
+    std::condition_variable m_idleCondition;
+    std::condition_variable m_timerCondition;
+    std::atomic<bool> m_stop{false};
+
+    /* Processes suspended in system calls, by Task::key: */
+    std::mutex m_parkedMutex;
+    std::unordered_map<void const *, Task> m_parked;
+    /** Processes woken up before they were parked. */
+    std::unordered_set<void const *> m_woken;
+
+    std::thread m_timerThread;
+
+}; /* class SchedulerState */
+
+} /* namespace Detail { */
+
+struct __attribute__((visibility("internal"))) Scheduler::Inner final
+    : Detail::SchedulerState
+{ using Detail::SchedulerState::SchedulerState; };
+
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_LIBVM_SCHEDULER_P_H */
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#include "Sha256.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+
+namespace sharemind {
+namespace Detail {
+
+namespace {
+
+constexpr std::uint32_t const roundConstants[64u] = {
+    0x428a2f98u, 0x71374491u, 0xb5c0fbcfu, 0xe9b5dba5u,
+    0x3956c25bu, 0x59f111f1u, 0x923f82a4u, 0xab1c5ed5u,
+    0xd807aa98u, 0x12835b01u, 0x243185beu, 0x550c7dc3u,
+    0x72be5d74u, 0x80deb1feu, 0x9bdc06a7u, 0xc19bf174u,
+    0xe49b69c1u, 0xefbe4786u, 0x0fc19dc6u, 0x240ca1ccu,
+    0x2de92c6fu, 0x4a7484aau, 0x5cb0a9dcu, 0x76f988dau,
+    0x983e5152u, 0xa831c66du, 0xb00327c8u, 0xbf597fc7u,
+    0xc6e00bf3u, 0xd5a79147u, 0x06ca6351u, 0x14292967u,
+    0x27b70a85u, 0x2e1b2138u, 0x4d2c6dfcu, 0x53380d13u,
+    0x650a7354u, 0x766a0abbu, 0x81c2c92eu, 0x92722c85u,
+    0xa2bfe8a1u, 0xa81a664bu, 0xc24b8b70u, 0xc76c51a3u,
+    0xd192e819u, 0xd6990624u, 0xf40e3585u, 0x106aa070u,
+    0x19a4c116u, 0x1e376c08u, 0x2748774cu, 0x34b0bcb5u,
+    0x391c0cb3u, 0x4ed8aa4au, 0x5b9cca4fu, 0x682e6ff3u,
+    0x748f82eeu, 0x78a5636fu, 0x84c87814u, 0x8cc70208u,
+    0x90befffau, 0xa4506cebu, 0xbef9a3f7u, 0xc67178f2u
+};
+
+constexpr std::uint32_t rotr(std::uint32_t const x, unsigned const n) noexcept
+{ return (x >> n) | (x << (32u - n)); }
+
+} // anonymous namespace
+
+Sha256::Sha256() noexcept
+    : m_state{0x6a09e667u, 0xbb67ae85u, 0x3c6ef372u, 0xa54ff53au,
+              0x510e527fu, 0x9b05688cu, 0x1f83d9abu, 0x5be0cd19u}
+    , m_blockSize(0u)
+    , m_totalSize(0u)
+{}
+
+void Sha256::update(void const * const data, std::size_t size) noexcept {
+    auto const * p = static_cast<unsigned char const *>(data);
+    m_totalSize += size;
+    if (m_blockSize) {
+        auto const n = std::min(size, sizeof(m_block) - m_blockSize);
+        std::memcpy(m_block + m_blockSize, p, n);
+        m_blockSize += n;
+        p += n;
+        size -= n;
+        if (m_blockSize < sizeof(m_block))
+            return;
+        processBlock(m_block);
+        m_blockSize = 0u;
+    }
+    for (; size >= sizeof(m_block); size -= sizeof(m_block)) {
+        processBlock(p);
+        p += sizeof(m_block);
+    }
+    if (size) {
+        std::memcpy(m_block, p, size);
+        m_blockSize = size;
+    }
+}
+
+Sha256::Digest Sha256::finish() noexcept {
+    auto const totalBits = m_totalSize * 8u;
+    unsigned char padding[72u] = { 0x80u };
+    auto const paddingSize =
+            ((m_blockSize < 56u) ? 56u : 120u) - m_blockSize;
+    for (unsigned i = 0u; i < 8u; ++i)
+        padding[paddingSize + i] =
+                static_cast<unsigned char>(totalBits >> (56u - 8u * i));
+    update(padding, paddingSize + 8u);
+    assert(!m_blockSize);
+
+    Digest r;
+    for (unsigned i = 0u; i < 8u; ++i)
+        for (unsigned j = 0u; j < 4u; ++j)
+            r[i * 4u + j] =
+                    static_cast<unsigned char>(m_state[i] >> (24u - 8u * j));
+    *this = Sha256();
+    return r;
+}
+
+void Sha256::processBlock(unsigned char const * const block) noexcept {
+    std::uint32_t w[64u];
+    for (unsigned i = 0u; i < 16u; ++i)
+        w[i] = (static_cast<std::uint32_t>(block[i * 4u]) << 24u)
+               | (static_cast<std::uint32_t>(block[i * 4u + 1u]) << 16u)
+               | (static_cast<std::uint32_t>(block[i * 4u + 2u]) << 8u)
+               | static_cast<std::uint32_t>(block[i * 4u + 3u]);
+    for (unsigned i = 16u; i < 64u; ++i) {
+        auto const x = w[i - 15u];
+        auto const y = w[i - 2u];
+        auto const s0 = rotr(x, 7u) ^ rotr(x, 18u) ^ (x >> 3u);
+        auto const s1 = rotr(y, 17u) ^ rotr(y, 19u) ^ (y >> 10u);
+        w[i] = w[i - 16u] + s0 + w[i - 7u] + s1;
+    }
+
+    auto a = m_state[0u];
+    auto b = m_state[1u];
+    auto c = m_state[2u];
+    auto d = m_state[3u];
+    auto e = m_state[4u];
+    auto f = m_state[5u];
+    auto g = m_state[6u];
+    auto h = m_state[7u];
+    for (unsigned i = 0u; i < 64u; ++i) {
+        auto const s1 = rotr(e, 6u) ^ rotr(e, 11u) ^ rotr(e, 25u);
+        auto const ch = (e & f) ^ (~e & g);
+        auto const t1 = h + s1 + ch + roundConstants[i] + w[i];
+        auto const s0 = rotr(a, 2u) ^ rotr(a, 13u) ^ rotr(a, 22u);
+        auto const maj = (a & b) ^ (a & c) ^ (b & c);
+        auto const t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    m_state[0u] += a;
+    m_state[1u] += b;
+    m_state[2u] += c;
+    m_state[3u] += d;
+    m_state[4u] += e;
+    m_state[5u] += f;
+    m_state[6u] += g;
+    m_state[7u] += h;
+}
+
+} /* namespace Detail { */
+} /* namespace sharemind { */
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2015 Cybernetica
+ *
+ * Research/Commercial License Usage
+ * Licensees holding a valid Research License or Commercial License
+ * for the Software may use this file according to the written
+ * agreement between you and Cybernetica.
+ *
+ * GNU General Public License Usage
+ * Alternatively, this file may be used under the terms of the GNU
+ * General Public License version 3.0 as published by the Free Software
+ * Foundation and appearing in the file LICENSE.GPL included in the
+ * packaging of this file.  Please review the following information to
+ * ensure the GNU General Public License version 3.0 requirements will be
+ * met: http://www.gnu.org/copyleft/gpl-3.0.html.
+ *
+ * For further information, please contact us at sharemind@cyber.ee.
+ */
+
+#ifndef SHAREMIND_LIBVM_SHA256_H
+#define SHAREMIND_LIBVM_SHA256_H
+
+#ifndef SHAREMIND_INTERNAL_
+#error including an internal header!
+#endif
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace sharemind {
+namespace Detail {
+
+/** \brief An incremental SHA-256 hash, as specified in FIPS 180-4. */
+class __attribute__((visibility("internal"))) Sha256 {
+
+public: /* Types: */
+
+    using Digest = std::array<unsigned char, 32u>;
+
+public: /* Methods: */
+
+    Sha256() noexcept;
+
+    void update(void const * data, std::size_t size) noexcept;
+
+    /** \brief Returns the digest of the data, after which *this is reset. */
+    Digest finish() noexcept;
+
+private: /* Methods: */
+
+    void processBlock(unsigned char const * block) noexcept;
+
+private: /* Fields: */
+
+    std::uint32_t m_state[8u];
+    unsigned char m_block[64u];
+    std::size_t m_blockSize;
+    std::uint64_t m_totalSize;
+
+};
+
+} /* namespace Detail { */
+} /* namespace sharemind { */
+
+#endif /* SHAREMIND_LIBVM_SHA256_H */
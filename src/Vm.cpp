@@ -24,6 +24,7 @@
 #include <cstdlib>
 #include <sharemind/AssertReturn.h>
 #include <utility>
+#include "BuiltinSyscalls.h"
 
 
 namespace sharemind {
@@ -37,23 +38,86 @@ namespace Detail {
 VmState::~VmState() noexcept = default;
 
 std::shared_ptr<Vm::SyscallWrapper> VmState::findSyscall(
-        std::string const & signature) const noexcept
+        std::string const & signature,
+        SyscallFinderSnapshot const * const snapshot) const noexcept
 {
+    /* Lookups of resolved signatures only share the cache lock: */
+    {
+        std::shared_lock<std::shared_timed_mutex> const cacheGuard(
+                    m_syscallCacheMutex);
+        if (!snapshot || (snapshot->generation == m_syscallFinderGeneration))
+        {
+            auto const it(m_syscallCache.find(signature));
+            if (it != m_syscallCache.end())
+                return it->second;
+        }
+    }
+
+    /*
+      Resolve misses via the syscall finder. The cache is only modified under
+      m_mutex, hence it can be read here without the cache lock:
+    */
     INNERGUARD;
-    if (m_syscallFinder && *m_syscallFinder)
-        return (*m_syscallFinder)(signature);
-    return nullptr;
+    bool const isCurrent =
+            !snapshot || (snapshot->generation == m_syscallFinderGeneration);
+    if (isCurrent) {
+        auto const it(m_syscallCache.find(signature));
+        if (it != m_syscallCache.end())
+            return it->second;
+    }
+    auto const & finder = isCurrent ? m_syscallFinder : snapshot->finder;
+    std::shared_ptr<Vm::SyscallWrapper> wrapper;
+    if (finder && *finder)
+        wrapper = (*finder)(signature);
+    if (!wrapper)
+        wrapper = findBuiltinSyscall(signature);
+    /* Failures are not memoized, these fail loading anyway: */
+    if (!wrapper || !isCurrent)
+        return wrapper;
+    try {
+        std::lock_guard<std::shared_timed_mutex> const cacheGuard(
+                    m_syscallCacheMutex);
+        m_syscallCache.emplace(signature, wrapper);
+    } catch (...) {} // Memoization is optional
+    return wrapper;
+}
+
+SyscallFinderSnapshot VmState::syscallFinder() const {
+    INNERGUARD;
+    return SyscallFinderSnapshot{m_syscallFinder, m_syscallFinderGeneration};
 }
 
 std::shared_ptr<void> VmState::findProcessFacility(char const * name)
         const noexcept
 {
-    INNERGUARD;
-    if (m_processFacilityFinder && *m_processFacilityFinder)
-        return (*m_processFacilityFinder)(name);
+    /* Only copy the finder under the lock, call it without locking: */
+    Vm::FacilityFinderFunPtr finder;
+    {
+        INNERGUARD;
+        finder = m_processFacilityFinder;
+    }
+    if (finder && *finder)
+        return (*finder)(name);
     return nullptr;
 }
 
+void VmState::addOpcodeCounts(Vm::OpcodeCounts const & counts) {
+    INNERGUARD;
+    for (auto const & count : counts.instructions)
+        m_opcodeCounts.instructions[count.first] += count.second;
+    for (auto const & count : counts.instructionPairs)
+        m_opcodeCounts.instructionPairs[count.first] += count.second;
+}
+
+void VmState::addSyscallStatistics(
+        Vm::SyscallStatisticsMap const & statistics)
+{
+    INNERGUARD;
+    for (auto const & syscallStatistics : statistics)
+        m_syscallStatistics[syscallStatistics.first] +=
+                syscallStatistics.second;
+}
+
 } // namespace Detail {
 
 
@@ -62,6 +126,8 @@ Vm::SyscallContext::~SyscallContext() noexcept = default;
 Vm::SyscallWrapper::~SyscallWrapper() noexcept = default;
 
 
+constexpr std::size_t const Vm::defaultMaxInflatedExecutableSize;
+
 Vm::Vm() : m_inner(std::make_shared<Inner>()) {}
 
 Vm::~Vm() noexcept {}
@@ -69,6 +135,11 @@ Vm::~Vm() noexcept {}
 void Vm::setSyscallFinder(SyscallFinderFunPtr f) noexcept {
     GUARD;
     m_inner->m_syscallFinder = std::move(f);
+    /* Invalidate the memoized lookups of the previous finder: */
+    std::lock_guard<std::shared_timed_mutex> const cacheGuard(
+                m_inner->m_syscallCacheMutex);
+    ++m_inner->m_syscallFinderGeneration;
+    m_inner->m_syscallCache.clear();
 }
 
 std::shared_ptr<Vm::SyscallWrapper> Vm::findSyscall(
@@ -78,9 +149,52 @@ std::shared_ptr<Vm::SyscallWrapper> Vm::findSyscall(
 void Vm::setProcessFacilityFinder(FacilityFinderFunPtr f) noexcept {
     GUARD;
     m_inner->m_processFacilityFinder = std::move(f);
+    m_inner->m_facilityFinderGeneration.fetch_add(1u,
+                                                  std::memory_order_release);
 }
 
 std::shared_ptr<void> Vm::findProcessFacility(char const * name) const noexcept
 { return m_inner->findProcessFacility(name); }
 
+void Vm::setMaxInflatedExecutableSize(std::size_t const size) noexcept
+{ m_inner->m_maxInflatedExecutableSize.store(size, std::memory_order_relaxed); }
+
+std::size_t Vm::maxInflatedExecutableSize() const noexcept {
+    return m_inner->m_maxInflatedExecutableSize.load(
+                std::memory_order_relaxed);
+}
+
+void Vm::setOpcodeCountingEnabled(bool const enabled) noexcept
+{ m_inner->m_countOpcodes.store(enabled, std::memory_order_relaxed); }
+
+bool Vm::opcodeCountingEnabled() const noexcept
+{ return m_inner->m_countOpcodes.load(std::memory_order_relaxed); }
+
+Vm::OpcodeCounts Vm::opcodeCounts() const {
+    GUARD;
+    return m_inner->m_opcodeCounts;
+}
+
+void Vm::resetOpcodeCounts() noexcept {
+    GUARD;
+    m_inner->m_opcodeCounts.instructions.clear();
+    m_inner->m_opcodeCounts.instructionPairs.clear();
+}
+
+void Vm::setSyscallStatisticsEnabled(bool const enabled) noexcept
+{ m_inner->m_timeSyscalls.store(enabled, std::memory_order_relaxed); }
+
+bool Vm::syscallStatisticsEnabled() const noexcept
+{ return m_inner->m_timeSyscalls.load(std::memory_order_relaxed); }
+
+Vm::SyscallStatisticsMap Vm::syscallStatistics() const {
+    GUARD;
+    return m_inner->m_syscallStatistics;
+}
+
+void Vm::resetSyscallStatistics() noexcept {
+    GUARD;
+    m_inner->m_syscallStatistics.clear();
+}
+
 } // namespace sharemind {
@@ -22,8 +22,12 @@
 
 #include <functional>
 
+#include <array>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <exception>
+#include <map>
 #include <memory>
 #include <sharemind/codeblock.h>
 #include <string>
@@ -34,6 +38,7 @@
 
 namespace sharemind {
 
+namespace Detail { struct ProcessState; }
 class Program;
 
 class Vm {
@@ -116,6 +121,65 @@ public: /* Types: */
     };
     using ConstReferenceVector = std::vector<ConstReference>;
 
+    /**
+      \brief A handle to a suspended system call.
+      \details Obtained from SyscallContext::suspend() and used to complete the
+               system call later, possibly from another thread.
+    */
+    class PendingSyscall {
+
+        friend struct Detail::ProcessState;
+
+    private: /* Types: */
+
+        struct Inner;
+
+    public: /* Methods: */
+
+        PendingSyscall() noexcept = default;
+        PendingSyscall(PendingSyscall &&) noexcept = default;
+        PendingSyscall(PendingSyscall const &) noexcept = default;
+
+        ~PendingSyscall() noexcept;
+
+        PendingSyscall & operator=(PendingSyscall &&) noexcept = default;
+        PendingSyscall & operator=(PendingSyscall const &) noexcept = default;
+
+        /**
+          \brief Completes the system call without writing a return value.
+          \note Has no effect if the system call has already been completed
+                or failed.
+        */
+        void complete() noexcept;
+
+        /**
+          \brief Completes the system call with the given return value.
+          \note Has no effect if the system call has already been completed
+                or failed.
+        */
+        void complete(::SharemindCodeBlock returnValue) noexcept;
+
+        /**
+          \brief Fails the system call with the given exception.
+          \details The process will crash with a
+                   Process::SystemCallErrorException when resumed.
+          \note Has no effect if the system call has already been completed
+                or failed.
+        */
+        void fail(std::exception_ptr exception) noexcept;
+
+    private: /* Methods: */
+
+        PendingSyscall(std::shared_ptr<Inner> inner) noexcept
+            : m_inner(std::move(inner))
+        {}
+
+    private: /* Fields: */
+
+        std::shared_ptr<Inner> m_inner;
+
+    };
+
     struct SyscallContext {
 
     /* Types: */
@@ -141,6 +205,18 @@ public: /* Types: */
         virtual std::size_t currentLinkingUnitIndex() const noexcept = 0;
         virtual std::size_t currentInstructionIndex() const noexcept = 0;
 
+        /**
+          \brief Suspends the current system call.
+          \details After the system call returns, the process stops as
+                   suspended (see Process::ExecutionResult) instead of
+                   continuing. The arguments, references and return value
+                   pointer of the system call remain valid until the system
+                   call is completed via the returned handle, after which the
+                   process can be resumed.
+          \returns a handle to complete the system call with.
+        */
+        virtual PendingSyscall suspend() = 0;
+
     };
 
     struct SyscallWrapper {
@@ -167,6 +243,77 @@ public: /* Types: */
     using FacilityFinderFun = std::function<FacilityFinder>;
     using FacilityFinderFunPtr = std::shared_ptr<FacilityFinderFun>;
 
+    /**
+      \brief Dynamic instruction execution counts, keyed by the LibVmi
+             instruction codes (see sharemind::VmInstructionInfo::code).
+    */
+    struct OpcodeCounts {
+
+    /* Fields: */
+
+        /** The number of times each instruction was executed. */
+        std::map<std::uint64_t, std::uint64_t> instructions;
+
+        /**
+          \brief The number of times each instruction (second) was executed
+                 directly after another instruction (first).
+        */
+        std::map<std::pair<std::uint64_t, std::uint64_t>, std::uint64_t>
+                instructionPairs;
+
+    };
+
+    /**
+      \brief Call count and latency statistics of a system call binding.
+      \details The latency of a system call which suspends the process is
+               measured until the call is completed via its PendingSyscall.
+               Abandoned calls which throw after suspending are recorded when
+               they throw.
+    */
+    struct SyscallStatistics {
+
+    /* Constants: */
+
+        static constexpr std::size_t const numHistogramBuckets = 64u;
+
+    /* Methods: */
+
+        SyscallStatistics & operator+=(SyscallStatistics const & other)
+                noexcept
+        {
+            calls += other.calls;
+            totalTime += other.totalTime;
+            if (other.maxTime > maxTime)
+                maxTime = other.maxTime;
+            for (std::size_t i = 0u; i < numHistogramBuckets; ++i)
+                histogram[i] += other.histogram[i];
+            return *this;
+        }
+
+    /* Fields: */
+
+        std::uint64_t calls = 0u;
+        std::chrono::nanoseconds totalTime{0};
+        std::chrono::nanoseconds maxTime{0};
+
+        /**
+          \brief The number of calls by latency, on a log2 scale.
+          \details Bucket 0 counts calls taking less than a nanosecond, bucket
+                   i > 0 calls taking at least 2^(i-1) and less than 2^i
+                   nanoseconds. The last bucket also counts all longer calls.
+        */
+        std::array<std::uint64_t, numHistogramBuckets> histogram{{}};
+
+    };
+
+    /** Syscall statistics keyed by the system call binding signatures. */
+    using SyscallStatisticsMap = std::map<std::string, SyscallStatistics>;
+
+public: /* Constants: */
+
+    static constexpr std::size_t const defaultMaxInflatedExecutableSize =
+            std::size_t(1u) << 30u;
+
 public: /* Methods: */
 
     Vm();
@@ -228,6 +375,57 @@ public: /* Methods: */
 
     std::shared_ptr<void> findProcessFacility(char const * name) const noexcept;
 
+    /**
+      \brief Sets the maximum size of the decompressed contents of
+             gzip-compressed executables.
+      \details Loading a compressed executable which inflates to more data
+               fails with Program::ImplementationLimitsReachedException.
+    */
+    void setMaxInflatedExecutableSize(std::size_t const size) noexcept;
+
+    std::size_t maxInflatedExecutableSize() const noexcept;
+
+    /**
+      \brief Enables or disables counting of executed instructions.
+      \details Applies to programs loaded afterwards. Programs loaded with
+               counting disabled execute at full speed. Every process of a
+               program loaded with counting enabled allocates 8 bytes for each
+               pair of the distinct instructions in its code.
+    */
+    void setOpcodeCountingEnabled(bool const enabled) noexcept;
+
+    bool opcodeCountingEnabled() const noexcept;
+
+    /**
+      \returns the instruction counts of all destroyed processes of programs
+               loaded with opcode counting enabled.
+      \see Process::opcodeCounts() for the counts of live processes.
+    */
+    OpcodeCounts opcodeCounts() const;
+
+    /** \brief Clears the counts returned by opcodeCounts(). */
+    void resetOpcodeCounts() noexcept;
+
+    /**
+      \brief Enables or disables the collection of system call statistics.
+      \details Applies to programs loaded afterwards, whose system call
+               bindings are then wrapped to time every call. Programs loaded
+               with the statistics disabled call their bindings directly.
+    */
+    void setSyscallStatisticsEnabled(bool const enabled) noexcept;
+
+    bool syscallStatisticsEnabled() const noexcept;
+
+    /**
+      \returns the system call statistics of all destroyed processes of
+               programs loaded with the statistics enabled.
+      \see Program::syscallStatistics() and Process::syscallStatistics()
+    */
+    SyscallStatisticsMap syscallStatistics() const;
+
+    /** \brief Clears the statistics returned by syscallStatistics(). */
+    void resetSyscallStatistics() noexcept;
+
 private: /* Fields: */
 
     std::shared_ptr<Inner> m_inner;
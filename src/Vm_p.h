@@ -26,14 +26,30 @@
 
 #include "Vm.h"
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <unordered_map>
 
 
 namespace sharemind {
 namespace Detail {
 
+/** \brief The syscall finder of a VM at some point in time. */
+struct __attribute__((visibility("internal"))) SyscallFinderSnapshot {
+
+/* Fields: */
+
+    Vm::SyscallFinderFunPtr finder;
+    /** The number of times the finder of the VM had been replaced. */
+    std::uint64_t generation;
+
+};
+
 class __attribute__((visibility("internal"))) VmState {
 
     friend class sharemind::Vm;
@@ -43,16 +59,84 @@ public: /* Methods: */
     ~VmState() noexcept;
 
     std::shared_ptr<Vm::SyscallWrapper> findSyscall(
-                std::string const & signature) const noexcept;
+                std::string const & signature) const noexcept
+    { return findSyscall(signature, nullptr); }
+
+    /**
+      \brief Finds a system call like the VM did when the given snapshot of
+             its syscall finder was taken.
+      \details Lookups are only memoized while the finder of the VM is the
+               one of the snapshot.
+    */
+    std::shared_ptr<Vm::SyscallWrapper> findSyscall(
+                std::string const & signature,
+                SyscallFinderSnapshot const * snapshot) const noexcept;
+
+    SyscallFinderSnapshot syscallFinder() const;
 
     std::shared_ptr<void> findProcessFacility(char const * name) const noexcept;
 
+    /** \brief Adds the instruction counts of a destroyed process. */
+    void addOpcodeCounts(Vm::OpcodeCounts const & counts);
+
+    /** \brief Adds the system call statistics of a destroyed process. */
+    void addSyscallStatistics(Vm::SyscallStatisticsMap const & statistics);
+
+private: /* Types: */
+
+    using SyscallCache =
+            std::unordered_map<std::string,
+                               std::shared_ptr<Vm::SyscallWrapper> >;
+
 private: /* Fields: */
 
     mutable std::recursive_mutex m_mutex;
     Vm::SyscallFinderFunPtr m_syscallFinder;
+    /**
+      \brief The number of times m_syscallFinder has been replaced.
+      \details Modified under both m_mutex and an exclusive lock of
+               m_syscallCacheMutex.
+    */
+    std::uint64_t m_syscallFinderGeneration = 0u;
+
+    /**
+      \brief The memoized syscall lookups of m_syscallFinder.
+      \details Read under a shared lock of m_syscallCacheMutex, so that
+               lookups of already resolved signatures do not serialize.
+               Modified under both m_mutex and an exclusive lock of
+               m_syscallCacheMutex.
+    */
+    mutable SyscallCache m_syscallCache;
+    mutable std::shared_timed_mutex m_syscallCacheMutex;
+
+    /** Guarded by m_mutex. */
     Vm::FacilityFinderFunPtr m_processFacilityFinder;
 
+    /** Guarded by m_mutex. */
+    Vm::OpcodeCounts m_opcodeCounts;
+
+    /** Guarded by m_mutex. */
+    Vm::SyscallStatisticsMap m_syscallStatistics;
+
+public: /* Fields: */
+
+    /**
+      \brief Incremented whenever the process facility finder of the VM is
+             replaced.
+      \details Used to invalidate memoized process facility lookups.
+    */
+    std::atomic<std::uint64_t> m_facilityFinderGeneration{0u};
+
+    /** Whether programs are prepared with opcode counting enabled. */
+    std::atomic<bool> m_countOpcodes{false};
+
+    /** Whether programs are prepared with timed system call bindings. */
+    std::atomic<bool> m_timeSyscalls{false};
+
+    /** See Vm::setMaxInflatedExecutableSize(). */
+    std::atomic<std::size_t> m_maxInflatedExecutableSize{
+            Vm::defaultMaxInflatedExecutableSize};
+
 }; /* struct VmState */
 
 } /* namespace Detail { */